@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "gezira.h"
 #include "gezira-image.h"
+#include "gezira-texture.h"
 #include <IL/ilu.h>
 
 #include "SDL.h"
@@ -90,7 +91,7 @@ main (int argc, char **argv)
                     NULL));
             nile_feed (nl, nile_Pipeline (nl,
                 gezira_Rasterize (nl),
-                gezira_ApplyTexture (nl, s),
+                gezira_ApplyTexture_Loop (nl, s),
                 gezira_WriteToImage_ARGB32 (nl, temp_pixels, width, height, width),
                 NULL),
                 rect, 6, 6*4, 1);
@@ -103,7 +104,7 @@ main (int argc, char **argv)
                     NULL));
             nile_feed (nl, nile_Pipeline (nl,
                 gezira_Rasterize (nl),
-                gezira_ApplyTexture (nl, s),
+                gezira_ApplyTexture_Loop (nl, s),
                 gezira_WriteToImage_ARGB32 (nl, image->pixels, width, height,
                                                 image->pitch / 4),
                 NULL),
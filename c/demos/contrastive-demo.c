@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "gezira.h"
 #include "gezira-image.h"
+#include "gezira-texture.h"
 #include <IL/ilu.h>
 
 #include "SDL.h"
@@ -146,7 +147,7 @@ main (int argc, char **argv)
                 gezira_TransformBeziers (nl, M.a, M.b, M.c, M.d, M.e, M.f),
                 gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
                 gezira_Rasterize (nl),
-                gezira_ApplyTexture (nl, texture),
+                gezira_ApplyTexture_Loop (nl, texture),
                 gezira_WriteToImage_ARGB32 (nl, image->pixels,
                                             DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                             image->pitch / 4),
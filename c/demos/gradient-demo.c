@@ -3,6 +3,7 @@
 #include "nile.h"
 #include "gezira.h"
 #include "gezira-image.h"
+#include "gezira-texture.h"
 #include "utils/all.h"
 
 #define NBYTES_PER_THREAD 1000000
@@ -81,7 +82,7 @@ gezira_snowflake_render (gezira_snowflake_t *flake,
         gezira_TransformBeziers (init, M.a, M.b, M.c, M.d, M.e, M.f),
         gezira_ClipBeziers (init, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT),
         gezira_Rasterize (init),
-        gezira_ApplyTexture (init, texture),
+        gezira_ApplyTexture_Loop (init, texture),
         gezira_WriteToImage_ARGB32 (init, &window->image),
         NILE_NULL);
     nile_Process_feed (pipeline, snowflake_path, snowflake_path_n);
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "gezira.h"
 #include "gezira-image.h"
+#include "gezira-texture.h"
 #include <IL/ilu.h>
 
 #include "SDL.h"
@@ -100,7 +101,7 @@ draw_handles (nile_t *nl, real *path, int path_n, SDL_Surface *image)
             stroke,
             gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
             gezira_Rasterize (nl),
-            gezira_ApplyTexture (nl, texture),
+            gezira_ApplyTexture_Loop (nl, texture),
             gezira_WriteToImage_ARGB32 (nl, image->pixels,
                                         DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                         image->pitch / 4),
@@ -125,7 +126,7 @@ draw_shadow (nile_t *nl, real *path, int path_n, nile_Kernel_t *k, SDL_Surface *
     pipeline = nile_Pipeline (nl, k->clone (nl, k),
         gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
         gezira_Rasterize (nl),
-        gezira_ApplyTexture (nl, gezira_UniformColor (nl, SHADOW_ALPHA, 0, 0, 0)),
+        gezira_ApplyTexture_Loop (nl, gezira_UniformColor (nl, SHADOW_ALPHA, 0, 0, 0)),
         gezira_WriteToImage_ARGB32 (nl, shadow_pixels[0],
                                     DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                     DEFAULT_WIDTH),
@@ -180,7 +181,7 @@ draw_shadow (nile_t *nl, real *path, int path_n, nile_Kernel_t *k, SDL_Surface *
     pipeline = nile_Pipeline (nl,
         gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
         gezira_Rasterize (nl),
-        gezira_ApplyTexture (nl, texture),
+        gezira_ApplyTexture_Loop (nl, texture),
         gezira_WriteToImage_ARGB32 (nl, shadow_pixels[1],
                                     DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                     DEFAULT_WIDTH),
@@ -202,7 +203,7 @@ draw_shadow (nile_t *nl, real *path, int path_n, nile_Kernel_t *k, SDL_Surface *
     pipeline = nile_Pipeline (nl,
         gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
         gezira_Rasterize (nl),
-        gezira_ApplyTexture (nl, texture),
+        gezira_ApplyTexture_Loop (nl, texture),
         gezira_WriteToImage_ARGB32 (nl, shadow_pixels[0],
                                     DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                     DEFAULT_WIDTH),
@@ -224,7 +225,7 @@ draw_shadow (nile_t *nl, real *path, int path_n, nile_Kernel_t *k, SDL_Surface *
     pipeline = nile_Pipeline (nl,
         gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
         gezira_Rasterize (nl),
-        gezira_ApplyTexture (nl, texture),
+        gezira_ApplyTexture_Loop (nl, texture),
         gezira_WriteToImage_ARGB32 (nl, image->pixels,
                                     DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                     image->pitch / 4),
@@ -355,7 +356,7 @@ main (int argc, char **argv)
                 stroke,
                 gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
                 gezira_Rasterize (nl),
-                gezira_ApplyTexture (nl, texture),
+                gezira_ApplyTexture_Loop (nl, texture),
                 gezira_WriteToImage_ARGB32 (nl, image->pixels,
                                             DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                             image->pitch / 4),
@@ -382,7 +383,7 @@ main (int argc, char **argv)
                 gezira_TransformBeziers (nl, M.a, M.b, M.c, M.d, M.e, M.f),
                 gezira_ClipBeziers (nl, 0, 0, DEFAULT_WIDTH, DEFAULT_HEIGHT),
                 gezira_Rasterize (nl),
-                gezira_ApplyTexture (nl, texture),
+                gezira_ApplyTexture_Loop (nl, texture),
                 gezira_WriteToImage_ARGB32 (nl, image->pixels,
                                             DEFAULT_WIDTH, DEFAULT_HEIGHT,
                                             image->pitch / 4),
@@ -44,6 +44,7 @@ gezira_snowflake_render (gezira_snowflake_t *flake,
                          gezira_Window_t *window, nile_Process_t *init)
 {
     nile_Process_t *pipeline;
+    gezira_WindowRect_t box;
     Matrix_t M = Matrix ();
     if (gezira_snowflake_offscreen (flake))
         return;
@@ -53,6 +54,9 @@ gezira_snowflake_render (gezira_snowflake_t *flake,
     M = Matrix_translate (M, flake->x, flake->y);
     M = Matrix_rotate (M, flake->angle);
     M = Matrix_scale (M, flake->scale, flake->scale);
+    box = gezira_Window_damage_beziers (window, M, snowflake_path, snowflake_path_n);
+    if (gezira_WindowRect_is_empty (box))
+        return;
     pipeline = nile_Process_pipe (
         gezira_TransformBeziers (init, M.a, M.b, M.c, M.d, M.e, M.f),
         gezira_ClipBeziers (init, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT),
@@ -75,6 +79,7 @@ main (int argc, char **argv)
     int mem_size;
 
     gezira_Window_init (&window, WINDOW_WIDTH, WINDOW_HEIGHT);
+    gezira_Window_track_damage (&window, 1);
 
     for (i = 0; i < NFLAKES; i++) {
         flakes[i].x      = gezira_random (0, window.image.width);
@@ -140,6 +140,7 @@ gezira_falling_glyph_render (gezira_falling_glyph_t *fglyph,
                              gezira_Window_t *window, nile_Process_t *init)
 {
     nile_Process_t *pipeline;
+    gezira_WindowRect_t box;
     Matrix_t M = Matrix ();
     if (gezira_falling_glyph_offscreen (fglyph))
         return;
@@ -154,6 +155,9 @@ gezira_falling_glyph_render (gezira_falling_glyph_t *fglyph,
     M = Matrix_rotate (M, fglyph->angle);
     M = Matrix_translate (M, -20, -20);
 
+    box = gezira_Window_damage_beziers (window, M, fglyph->glyph->path, fglyph->glyph->path_n);
+    if (gezira_WindowRect_is_empty (box))
+        return;
     pipeline = nile_Process_pipe (
         gezira_TransformBeziers (init, M.a, M.b, M.c, M.d, M.e, M.f),
         gezira_ClipBeziers (init, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT),
@@ -188,6 +192,7 @@ main (int argc, char **argv)
     int nglyphs = (sizeof (glyphs) / sizeof (glyphs[0]));
 
     gezira_Window_init (&window, WINDOW_WIDTH, WINDOW_HEIGHT);
+    gezira_Window_track_damage (&window, 1);
 
     ft_error = FT_Init_FreeType (&ft);
     ft_error = FT_New_Face (ft, FONT_FILE, 0, &ft_face);
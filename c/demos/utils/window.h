@@ -1,17 +1,111 @@
 #ifndef GEZIRA_WINDOW_H
 #define GEZIRA_WINDOW_H
 #include <stdint.h>
+#include "matrix.h"
 
 typedef struct gezira_Window_ gezira_Window_t;
 
 typedef struct {
-    gezira_Window_t *window;
+    int x0, y0, x1, y1;
+} gezira_WindowRect_t;
+
+#define GEZIRA_WINDOW_RECTS 16
+
+/* Damage as a few boxes. Overlapping boxes are merged, and once there are
+   GEZIRA_WINDOW_RECTS of them a new box is merged into the one it grows
+   least. */
+typedef struct {
+    int                 n;
+    gezira_WindowRect_t rects[GEZIRA_WINDOW_RECTS];
+} gezira_WindowRects_t;
+
+/* With tracking on, an update presents only what was damaged since the
+   last update plus what that update had to present, and clears only the
+   former. */
+typedef struct {
+    int                  tracking;
+    gezira_WindowRect_t  bounds;
+    gezira_WindowRects_t dirty;
+    gezira_WindowRects_t last;
+} gezira_WindowDamage_t;
+
+typedef struct {
+    gezira_Window_t      *window;
+    gezira_WindowRects_t  rects;
 } gezira_WindowUpdate_vars_t;
 
+static int
+gezira_WindowRect_is_empty (gezira_WindowRect_t r)
+{
+    return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+static gezira_WindowRect_t
+gezira_WindowRect_union (gezira_WindowRect_t r, gezira_WindowRect_t s)
+{
+    if (gezira_WindowRect_is_empty (r))
+        return s;
+    if (gezira_WindowRect_is_empty (s))
+        return r;
+    r.x0 = r.x0 < s.x0 ? r.x0 : s.x0;
+    r.y0 = r.y0 < s.y0 ? r.y0 : s.y0;
+    r.x1 = r.x1 > s.x1 ? r.x1 : s.x1;
+    r.y1 = r.y1 > s.y1 ? r.y1 : s.y1;
+    return r;
+}
+
+static int
+gezira_WindowRect_area (gezira_WindowRect_t r)
+{
+    return gezira_WindowRect_is_empty (r) ? 0 : (r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+static void
+gezira_WindowRects_add (gezira_WindowRects_t *rs, gezira_WindowRect_t r)
+{
+    int i, best = 0, growth = -1;
+    if (gezira_WindowRect_is_empty (r))
+        return;
+    for (i = 0; i < rs->n; i++) {
+        gezira_WindowRect_t s = rs->rects[i];
+        if (s.x0 < r.x1 && r.x0 < s.x1 && s.y0 < r.y1 && r.y0 < s.y1) {
+            rs->rects[i] = rs->rects[--rs->n];
+            gezira_WindowRects_add (rs, gezira_WindowRect_union (s, r));
+            return;
+        }
+    }
+    if (rs->n < GEZIRA_WINDOW_RECTS) {
+        rs->rects[rs->n++] = r;
+        return;
+    }
+    for (i = 0; i < rs->n; i++) {
+        gezira_WindowRect_t s = rs->rects[i];
+        int g = gezira_WindowRect_area (gezira_WindowRect_union (s, r)) - gezira_WindowRect_area (s);
+        if (growth < 0 || g < growth) {
+            best = i;
+            growth = g;
+        }
+    }
+    r = gezira_WindowRect_union (rs->rects[best], r);
+    rs->rects[best] = rs->rects[--rs->n];
+    gezira_WindowRects_add (rs, r);
+}
+
+static void
+gezira_WindowDamage_init (gezira_WindowDamage_t *damage, int width, int height)
+{
+    gezira_WindowRect_t all = {0, 0, width, height};
+    damage->tracking = 0;
+    damage->bounds   = all;
+    damage->dirty.n  = damage->last.n = 1;
+    damage->dirty.rects[0] = damage->last.rects[0] = all;
+}
+
 #ifdef GEZIRA_WINDOW_NONE
 
 struct gezira_Window_ {
-    gezira_Image_t image;
+    gezira_Image_t        image;
+    gezira_WindowDamage_t damage;
 };
 
 static void
@@ -19,6 +113,7 @@ gezira_Window_init (gezira_Window_t *window, int width, int height)
 {
     void *pixels = malloc (width * height * sizeof (uint32_t));
     gezira_Image_init (&window->image, pixels, width, height, width);
+    gezira_WindowDamage_init (&window->damage, width, height);
 }
 
 static char
@@ -46,12 +141,13 @@ typedef long NSEventType;
 extern void* const NSDefaultRunLoopMode;
 
 struct gezira_Window_ {
-    gezira_Image_t image;
-    id             pool;
-    id             NSApp;
-    id             nswindow;
-    CGContextRef   context;
-    CGContextRef   bitmap;
+    gezira_Image_t        image;
+    gezira_WindowDamage_t damage;
+    id                    pool;
+    id                    NSApp;
+    id                    nswindow;
+    CGContextRef          context;
+    CGContextRef          bitmap;
 };
 
 static void
@@ -61,6 +157,7 @@ gezira_Window_init (gezira_Window_t *window, int width, int height)
     CGColorSpaceRef colorspace;
     void *pixels = malloc (width * height * sizeof (uint32_t));
     gezira_Image_init (&window->image, pixels, width, height, width);
+    gezira_WindowDamage_init (&window->damage, width, height);
 
     /* NSApp */
     window->NSApp = objc_msgSend (objc_getClass ("NSApplication"), sel_getUid ("sharedApplication"));
@@ -118,9 +215,18 @@ gezira_Window_fini (gezira_Window_t *window)
 static nile_Buffer_t *
 gezira_WindowUpdate_prologue (nile_Process_t *p, nile_Buffer_t *out)
 {
-    gezira_Window_t *window = *((gezira_Window_t **) nile_Process_vars (p));
+    gezira_WindowUpdate_vars_t v = *(gezira_WindowUpdate_vars_t *) nile_Process_vars (p);
+    gezira_Window_t *window = v.window;
     CGImageRef image = CGBitmapContextCreateImage (window->bitmap);
-    CGContextDrawImage (window->context, CGRectMake (0, 0, window->image.width, window->image.height), image);
+    int i;
+    for (i = 0; i < v.rects.n; i++) {
+        gezira_WindowRect_t r = v.rects.rects[i];
+        CGContextSaveGState (window->context);
+        CGContextClipToRect (window->context,
+                             CGRectMake (r.x0, window->image.height - r.y1, r.x1 - r.x0, r.y1 - r.y0));
+        CGContextDrawImage (window->context, CGRectMake (0, 0, window->image.width, window->image.height), image);
+        CGContextRestoreGState (window->context);
+    }
     CGImageRelease (image);
     CGContextFlush (window->context);
     return out;
@@ -132,9 +238,10 @@ gezira_WindowUpdate_prologue (nile_Process_t *p, nile_Buffer_t *out)
 #include <windows.h>
 
 struct gezira_Window_ {
-    gezira_Image_t image;
-    BITMAPINFO     bmi;
-    HWND           win32window;
+    gezira_Image_t        image;
+    gezira_WindowDamage_t damage;
+    BITMAPINFO            bmi;
+    HWND                  win32window;
 };
 
 static void
@@ -151,6 +258,7 @@ gezira_Window_init (gezira_Window_t *window, int width, int height)
     } };
     void *pixels = malloc (width * height * sizeof (uint32_t));
     gezira_Image_init (&window->image, pixels, width, height, width);
+    gezira_WindowDamage_init (&window->damage, width, height);
     window->win32window = CreateWindow ("STATIC", NULL, WS_VISIBLE, // WS_BORDER WS_POPUP WS_CAPTION WS_OVERLAPPED
                                         0, 0, width, height,
                                         NULL, NULL, NULL, 0);
@@ -171,10 +279,18 @@ gezira_Window_fini (gezira_Window_t *window)
 static nile_Buffer_t *
 gezira_WindowUpdate_prologue (nile_Process_t *p, nile_Buffer_t *out)
 {
-    gezira_Window_t *window = *((gezira_Window_t **) nile_Process_vars (p));
+    gezira_WindowUpdate_vars_t v = *(gezira_WindowUpdate_vars_t *) nile_Process_vars (p);
+    gezira_Window_t *window = v.window;
     HDC dc = GetDC (window->win32window);
-    SetDIBitsToDevice (dc, 0, 0, window->image.width, window->image.height, 0, 0,
-                       0, window->image.height, window->image.pixels, &window->bmi, DIB_RGB_COLORS);
+    int i;
+    for (i = 0; i < v.rects.n; i++) {
+        gezira_WindowRect_t r = v.rects.rects[i];
+        SaveDC (dc);
+        IntersectClipRect (dc, r.x0, r.y0, r.x1, r.y1);
+        SetDIBitsToDevice (dc, 0, 0, window->image.width, window->image.height, 0, 0,
+                           0, window->image.height, window->image.pixels, &window->bmi, DIB_RGB_COLORS);
+        RestoreDC (dc, -1);
+    }
     ReleaseDC (window->win32window, dc);
     return out;
 }
@@ -188,12 +304,13 @@ gezira_WindowUpdate_prologue (nile_Process_t *p, nile_Buffer_t *out)
 #include <sys/shm.h>
 
 struct gezira_Window_ {
-    gezira_Image_t   image;
-    XShmSegmentInfo *segment;
-    Display         *display;
-    GC               gc;
-    XImage          *ximage;
-    Window           x11window;
+    gezira_Image_t        image;
+    gezira_WindowDamage_t damage;
+    XShmSegmentInfo      *segment;
+    Display              *display;
+    GC                    gc;
+    XImage               *ximage;
+    Window                x11window;
 };
 
 static void
@@ -219,6 +336,7 @@ gezira_Window_init (gezira_Window_t *window, int width, int height)
     window->segment->shmaddr = window->ximage->data =
         (char *) shmat (window->segment->shmid, 0, 0);
     gezira_Image_init (&window->image, window->ximage->data, width, height, width);
+    gezira_WindowDamage_init (&window->damage, width, height);
     window->segment->readOnly = True;
     XShmAttach (window->display, window->segment);
     shmctl (window->segment->shmid, IPC_RMID, NULL);
@@ -242,9 +360,14 @@ gezira_Window_fini (gezira_Window_t *window)
 static nile_Buffer_t *
 gezira_WindowUpdate_prologue (nile_Process_t *p, nile_Buffer_t *out)
 {
-    gezira_Window_t *window = *((gezira_Window_t **) nile_Process_vars (p));
-    XShmPutImage (window->display, window->x11window, window->gc, window->ximage, 0, 0, 0, 0,
-                  window->ximage->width, window->ximage->height, False);
+    gezira_WindowUpdate_vars_t v = *(gezira_WindowUpdate_vars_t *) nile_Process_vars (p);
+    gezira_Window_t *window = v.window;
+    int i;
+    for (i = 0; i < v.rects.n; i++) {
+        gezira_WindowRect_t r = v.rects.rects[i];
+        XShmPutImage (window->display, window->x11window, window->gc, window->ximage,
+                      r.x0, r.y0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, False);
+    }
     XSync (window->display, False);
     return out;
 }
@@ -254,7 +377,7 @@ gezira_WindowUpdate_prologue (nile_Process_t *p, nile_Buffer_t *out)
 #endif
 
 static nile_Process_t *
-gezira_WindowUpdate (nile_Process_t *p, gezira_Window_t *window)
+gezira_WindowUpdate (nile_Process_t *p, gezira_Window_t *window, gezira_WindowRects_t *rects)
 {
     nile_Process_t *parent = p;
     p = nile_Process (p, 1, sizeof (gezira_WindowUpdate_vars_t),
@@ -263,6 +386,7 @@ gezira_WindowUpdate (nile_Process_t *p, gezira_Window_t *window)
         gezira_WindowUpdate_vars_t *vars = nile_Process_vars (p);
         nile_Process_t *nextGate = nile_Identity (parent, 1);
         vars->window = window;
+        vars->rects = *rects;
         nile_Process_gate (p, nextGate);
         if (window->image.gate)
             p = nile_Process_pipe (window->image.gate, p, NILE_NULL);
@@ -271,16 +395,86 @@ gezira_WindowUpdate (nile_Process_t *p, gezira_Window_t *window)
     return p;
 }
 
+static void
+gezira_Window_track_damage (gezira_Window_t *window, int tracking)
+{
+    window->damage.tracking = tracking;
+}
+
+static float
+gezira_Window_clamp (float v, int lo, int hi)
+{
+    return v > lo ? (v < hi ? v : hi) : lo;
+}
+
+/* Returns the damaged box, clipped to the window and grown by a pixel for
+   antialiasing. It is empty when the area is outside the window. */
+static gezira_WindowRect_t
+gezira_Window_damage (gezira_Window_t *window, float min_x, float min_y, float max_x, float max_y)
+{
+    gezira_WindowRect_t b = window->damage.bounds;
+    gezira_WindowRect_t r = {floorf (gezira_Window_clamp (min_x, b.x0, b.x1)) - 1,
+                             floorf (gezira_Window_clamp (min_y, b.y0, b.y1)) - 1,
+                             ceilf  (gezira_Window_clamp (max_x, b.x0, b.x1)) + 1,
+                             ceilf  (gezira_Window_clamp (max_y, b.y0, b.y1)) + 1};
+    r.x0 = r.x0 > b.x0 ? r.x0 : b.x0;
+    r.y0 = r.y0 > b.y0 ? r.y0 : b.y0;
+    r.x1 = r.x1 < b.x1 ? r.x1 : b.x1;
+    r.y1 = r.y1 < b.y1 ? r.y1 : b.y1;
+    gezira_WindowRects_add (&window->damage.dirty, r);
+    return r;
+}
+
+/* Damages the bounds of the beziers' control points under M, which
+   contain the transformed path. */
+static gezira_WindowRect_t
+gezira_Window_damage_beziers (gezira_Window_t *window, Matrix_t M, const float *beziers, int n)
+{
+    float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+    int i;
+    for (i = 0; i + 1 < n; i += 2) {
+        float x = M.a * beziers[i] + M.c * beziers[i + 1] + M.e;
+        float y = M.b * beziers[i] + M.d * beziers[i + 1] + M.f;
+        min_x = x < min_x ? x : min_x;
+        min_y = y < min_y ? y : min_y;
+        max_x = x > max_x ? x : max_x;
+        max_y = y > max_y ? y : max_y;
+    }
+    if (n < 2) {
+        gezira_WindowRect_t none = {0, 0, 0, 0};
+        return none;
+    }
+    return gezira_Window_damage (window, min_x, min_y, max_x, max_y);
+}
+
 static void
 gezira_Window_update_and_clear (gezira_Window_t *window, nile_Process_t *init,
                                 float a, float r, float g, float b)
 {
-    nile_Process_feed (gezira_WindowUpdate (init, window), NULL, 0);
-    nile_Process_feed (nile_Process_pipe (
-            gezira_RectangleSpans (init, 0, 0, window->image.width, window->image.height),
-            gezira_CompositeUniformColorOverImage_ARGB32 (init, &window->image, a, r, g, b),
-            NILE_NULL),
-        NULL, 0);
+    gezira_WindowDamage_t *damage = &window->damage;
+    gezira_WindowRects_t present, clear;
+    int i;
+    if (!damage->tracking) {
+        damage->dirty.n = damage->last.n = 1;
+        damage->dirty.rects[0] = damage->last.rects[0] = damage->bounds;
+    }
+    present = damage->last;
+    for (i = 0; i < damage->dirty.n; i++)
+        gezira_WindowRects_add (&present, damage->dirty.rects[i]);
+    clear = damage->dirty;
+    damage->last = damage->dirty;
+    damage->dirty.n = 0;
+    if (!present.n)
+        return;
+    nile_Process_feed (gezira_WindowUpdate (init, window, &present), NULL, 0);
+    for (i = 0; i < clear.n; i++) {
+        gezira_WindowRect_t c = clear.rects[i];
+        nile_Process_feed (nile_Process_pipe (
+                gezira_RectangleSpans (init, c.x0, c.y0, c.x1, c.y1),
+                gezira_CompositeUniformColorOverImage_ARGB32 (init, &window->image, a, r, g, b),
+                NILE_NULL),
+            NULL, 0);
+    }
 }
 
 #endif
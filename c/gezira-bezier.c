@@ -0,0 +1,274 @@
+#include <stddef.h>
+#include <math.h>
+#define NILE_INCLUDE_PROCESS_API
+#include "nile.h"
+#include "gezira-cpu.h"
+#include "gezira-bezier.h"
+
+typedef struct {
+    float x, y;
+} gezira_Vector_t;
+
+static inline void
+gezira_push_point (nile_Buffer_t *out, gezira_Vector_t P)
+{
+    nile_Buffer_push_tail (out, nile_Real (P.x));
+    nile_Buffer_push_tail (out, nile_Real (P.y));
+}
+
+typedef struct {
+    float tolerance;
+    float M_a, M_b, M_c, M_d;
+} gezira_CubicsToBeziers_vars_t;
+
+/* The quadratic through a cubic's end points with the midpoint of the
+   control points' extensions, (3 (B + C) - (A + D)) / 4, strays at most
+   √3 / 36 |D - 3 C + 3 B - A| from it. Splitting into n steps divides the
+   third difference by n³. */
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_CubicsToBeziers_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_CubicsToBeziers_vars_t v = *(gezira_CubicsToBeziers_vars_t *) nile_Process_vars (p);
+
+    while (in->tail - in->head >= 8) {
+        gezira_Vector_t P[4], D3, MD3, Q0, dQ0;
+        float e;
+        int i, n;
+        for (i = 0; i < 4; i++) {
+            P[i].x = nile_Real_tof (nile_Buffer_pop_head (in));
+            P[i].y = nile_Real_tof (nile_Buffer_pop_head (in));
+        }
+        D3.x = P[3].x - 3 * P[2].x + 3 * P[1].x - P[0].x;
+        D3.y = P[3].y - 3 * P[2].y + 3 * P[1].y - P[0].y;
+        MD3.x = v.M_a * D3.x + v.M_c * D3.y;
+        MD3.y = v.M_b * D3.x + v.M_d * D3.y;
+        e = 0.0481125224f * hypotf (MD3.x, MD3.y) / v.tolerance;
+        n = e > 1 ? (int) ceilf (cbrtf (e)) : 1;
+        n = n < GEZIRA_CUBIC_MAX_BEZIERS ? n : GEZIRA_CUBIC_MAX_BEZIERS;
+
+        Q0 = P[0];
+        dQ0.x = 3 * (P[1].x - P[0].x) / n;
+        dQ0.y = 3 * (P[1].y - P[0].y) / n;
+        for (i = 1; i <= n; i++) {
+            float t = (float) i / n, s = 1 - t;
+            gezira_Vector_t Q3, dQ3, B;
+            if (i < n) {
+                Q3.x = s * s * s * P[0].x + 3 * s * s * t * P[1].x + 3 * s * t * t * P[2].x + t * t * t * P[3].x;
+                Q3.y = s * s * s * P[0].y + 3 * s * s * t * P[1].y + 3 * s * t * t * P[2].y + t * t * t * P[3].y;
+            }
+            else
+                Q3 = P[3];
+            dQ3.x = 3 * (s * s * (P[1].x - P[0].x) + 2 * s * t * (P[2].x - P[1].x) + t * t * (P[3].x - P[2].x)) / n;
+            dQ3.y = 3 * (s * s * (P[1].y - P[0].y) + 2 * s * t * (P[2].y - P[1].y) + t * t * (P[3].y - P[2].y)) / n;
+            /* (3 (Q1 + Q2) - (Q0 + Q3)) / 4 with Q1 = Q0 + dQ0 / 3, Q2 = Q3 - dQ3 / 3 */
+            B.x = (2 * (Q0.x + Q3.x) + dQ0.x - dQ3.x) / 4;
+            B.y = (2 * (Q0.y + Q3.y) + dQ0.y - dQ3.y) / 4;
+            if (nile_Buffer_tailroom (out) < 6)
+                out = nile_Process_append_output (p, out);
+            gezira_push_point (out, Q0);
+            gezira_push_point (out, B);
+            gezira_push_point (out, Q3);
+            Q0 = Q3;
+            dQ0 = dQ3;
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_CubicsToBeziers_body)
+
+nile_Process_t *
+gezira_CubicsToBeziers (nile_Process_t *p, float tolerance,
+                        float M_a, float M_b, float M_c, float M_d, float M_e, float M_f)
+{
+    gezira_CubicsToBeziers_vars_t *vars;
+    p = nile_Process (p, 8, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_CubicsToBeziers_body), NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->tolerance = tolerance > 0 ? tolerance : 0.1f;
+        vars->M_a = M_a;
+        vars->M_b = M_b;
+        vars->M_c = M_c;
+        vars->M_d = M_d;
+    }
+    return p;
+}
+
+typedef struct {
+    float  min_x, min_y, max_x, max_y;
+    float *carry;
+    int    row0, rows;
+} gezira_ClipBeziers_Analytic_vars_t;
+
+/* Adds the t in (0, 1) where a t² + b t + c = 0 to T */
+static int
+gezira_quadratic_roots (float a, float b, float c, float *T, int n)
+{
+    float d, q, t[2];
+    int   i, m = 0;
+    if (fabsf (a) < 1e-6f * (fabsf (b) + fabsf (c))) {
+        if (b != 0)
+            t[m++] = -c / b;
+    }
+    else if ((d = b * b - 4 * a * c) >= 0) {
+        q = -(b + copysignf (sqrtf (d), b)) / 2;
+        t[m++] = q / a;
+        if (q != 0)
+            t[m++] = c / q;
+    }
+    for (i = 0; i < m; i++)
+        if (t[i] > 1e-6f && t[i] < 1 - 1e-6f)
+            T[n++] = t[i];
+    return n;
+}
+
+static inline gezira_Vector_t
+gezira_blossom (const gezira_Vector_t *P, float t0, float t1)
+{
+    float a = (1 - t0) * (1 - t1), b = (1 - t0) * t1 + t0 * (1 - t1), c = t0 * t1;
+    gezira_Vector_t Q = {a * P[0].x + b * P[1].x + c * P[2].x,
+                         a * P[0].y + b * P[1].y + c * P[2].y};
+    return Q;
+}
+
+static inline gezira_Vector_t
+gezira_clamp (gezira_ClipBeziers_Analytic_vars_t *v, gezira_Vector_t P)
+{
+    P.x = P.x < v->min_x ? v->min_x : P.x > v->max_x ? v->max_x : P.x;
+    P.y = P.y < v->min_y ? v->min_y : P.y > v->max_y ? v->max_y : P.y;
+    return P;
+}
+
+/* Emits a piece projected onto the box, unless it collapses to a point.
+   With a carry, only pieces on the left edge have winding inside the box;
+   their signed height is added to each row they span instead. */
+static void
+gezira_clip_project (gezira_ClipBeziers_Analytic_vars_t *v, nile_Buffer_t *out,
+                     gezira_Vector_t A, gezira_Vector_t C)
+{
+    gezira_Vector_t B;
+    if (A.x == C.x && A.y == C.y)
+        return;
+    if (v->carry) {
+        if (A.x == v->min_x && C.x == v->min_x) {
+            float y0 = fminf (A.y, C.y), y1 = fmaxf (A.y, C.y);
+            float s = C.y > A.y ? 1 : -1;
+            int   j;
+            for (j = (int) floorf (y0); j < y1; j++)
+                if (v->row0 <= j && j < v->row0 + v->rows)
+                    v->carry[j - v->row0] += s * (fminf (y1, j + 1) - fmaxf (y0, j));
+        }
+        return;
+    }
+    B.x = (A.x + C.x) / 2;
+    B.y = (A.y + C.y) / 2;
+    gezira_push_point (out, A);
+    gezira_push_point (out, B);
+    gezira_push_point (out, C);
+}
+
+/* A piece between crossings is inside if its middle is */
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ClipBeziers_Analytic_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_ClipBeziers_Analytic_vars_t *v = nile_Process_vars (p);
+
+    while (in->tail - in->head >= 6) {
+        gezira_Vector_t P[3], min, max;
+        float T[10];
+        int   i, j, n = 0;
+        for (i = 0; i < 3; i++) {
+            P[i].x = nile_Real_tof (nile_Buffer_pop_head (in));
+            P[i].y = nile_Real_tof (nile_Buffer_pop_head (in));
+        }
+        min.x = fminf (P[0].x, fminf (P[1].x, P[2].x));
+        min.y = fminf (P[0].y, fminf (P[1].y, P[2].y));
+        max.x = fmaxf (P[0].x, fmaxf (P[1].x, P[2].x));
+        max.y = fmaxf (P[0].y, fmaxf (P[1].y, P[2].y));
+
+        if (nile_Buffer_tailroom (out) < 6 * 9)
+            out = nile_Process_append_output (p, out);
+        if (v->min_x <= min.x && max.x <= v->max_x && v->min_y <= min.y && max.y <= v->max_y) {
+            for (i = 0; i < 3; i++)
+                gezira_push_point (out, P[i]);
+            continue;
+        }
+        if (max.x <= v->min_x || v->max_x <= min.x || max.y <= v->min_y || v->max_y <= min.y) {
+            gezira_clip_project (v, out, gezira_clamp (v, P[0]), gezira_clamp (v, P[2]));
+            continue;
+        }
+
+        T[n++] = 0;
+        if (min.x < v->min_x && v->min_x < max.x)
+            n = gezira_quadratic_roots (P[0].x - 2 * P[1].x + P[2].x, 2 * (P[1].x - P[0].x),
+                                        P[0].x - v->min_x, T, n);
+        if (min.x < v->max_x && v->max_x < max.x)
+            n = gezira_quadratic_roots (P[0].x - 2 * P[1].x + P[2].x, 2 * (P[1].x - P[0].x),
+                                        P[0].x - v->max_x, T, n);
+        if (min.y < v->min_y && v->min_y < max.y)
+            n = gezira_quadratic_roots (P[0].y - 2 * P[1].y + P[2].y, 2 * (P[1].y - P[0].y),
+                                        P[0].y - v->min_y, T, n);
+        if (min.y < v->max_y && v->max_y < max.y)
+            n = gezira_quadratic_roots (P[0].y - 2 * P[1].y + P[2].y, 2 * (P[1].y - P[0].y),
+                                        P[0].y - v->max_y, T, n);
+        for (i = 2; i < n; i++)
+            for (j = i; j > 1 && T[j - 1] > T[j]; j--) {
+                float t = T[j]; T[j] = T[j - 1]; T[j - 1] = t;
+            }
+        T[n++] = 1;
+
+        for (i = 0; i + 1 < n; i++) {
+            float t0 = T[i], t1 = T[i + 1], tm = (t0 + t1) / 2;
+            gezira_Vector_t A = t0 > 0 ? gezira_blossom (P, t0, t0) : P[0];
+            gezira_Vector_t C = t1 < 1 ? gezira_blossom (P, t1, t1) : P[2];
+            gezira_Vector_t M = gezira_blossom (P, tm, tm);
+            if (t1 - t0 < 1e-6f)
+                continue;
+            A = gezira_clamp (v, A);
+            C = gezira_clamp (v, C);
+            if (v->min_x <= M.x && M.x <= v->max_x && v->min_y <= M.y && M.y <= v->max_y) {
+                gezira_push_point (out, A);
+                gezira_push_point (out, gezira_blossom (P, t0, t1));
+                gezira_push_point (out, C);
+            }
+            else {
+                /* The ends sit on crossings, which may land a hair inside */
+                if (M.x < v->min_x) A.x = C.x = v->min_x;
+                if (M.x > v->max_x) A.x = C.x = v->max_x;
+                if (M.y < v->min_y) A.y = C.y = v->min_y;
+                if (M.y > v->max_y) A.y = C.y = v->max_y;
+                gezira_clip_project (v, out, A, C);
+            }
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ClipBeziers_Analytic_body)
+
+nile_Process_t *
+gezira_ClipBeziers_Carry (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y,
+                          float *carry, int row0, int rows)
+{
+    gezira_ClipBeziers_Analytic_vars_t *vars;
+    p = nile_Process (p, 6, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ClipBeziers_Analytic_body), NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->min_x = min_x;
+        vars->min_y = min_y;
+        vars->max_x = max_x;
+        vars->max_y = max_y;
+        vars->carry = carry;
+        vars->row0 = row0;
+        vars->rows = rows;
+    }
+    return p;
+}
+
+nile_Process_t *
+gezira_ClipBeziers_Analytic (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y)
+{
+    return gezira_ClipBeziers_Carry (p, min_x, min_y, max_x, max_y, NULL, 0, 0);
+}
@@ -0,0 +1,30 @@
+#ifndef GEZIRA_BEZIER_H
+#define GEZIRA_BEZIER_H
+
+#include "nile.h"
+
+#define GEZIRA_CUBIC_MAX_BEZIERS 64
+
+/* Approximates each cubic (A, B, C, D) with as few quadratic beziers,
+   split at equal steps in t, as keep it within tolerance once transformed
+   by M. The beziers stay untransformed, ready for TransformBeziers or the
+   stroker. */
+nile_Process_t *
+gezira_CubicsToBeziers (nile_Process_t *p, float tolerance,
+                        float M_a, float M_b, float M_c, float M_d, float M_e, float M_f);
+
+/* ClipBeziers that cuts straddling beziers where they cross the clip box
+   edges, found analytically, rather than by repeated halving. Inside
+   pieces are kept and outside ones projected onto the box, as before. */
+nile_Process_t *
+gezira_ClipBeziers_Analytic (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y);
+
+/* ClipBeziers_Analytic that keeps off-box geometry out of the stream:
+   beziers projected onto the left edge add their signed height to
+   carry[y - row0] for each pixel row y they span, and the rest, which have
+   no winding inside the box, are dropped. */
+nile_Process_t *
+gezira_ClipBeziers_Carry (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y,
+                          float *carry, int row0, int rows);
+
+#endif
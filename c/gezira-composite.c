@@ -0,0 +1,681 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#define NILE_INCLUDE_PROCESS_API
+#include "nile.h"
+#include "gezira-cpu.h"
+#include "gezira-image.h"
+#include "gezira-texture.h"
+#include "gezira-composite.h"
+
+#define Real nile_Real_t
+
+static inline uint8_t
+Real_to_uint8_t (Real r)
+{
+    return nile_Real_toi (nile_Real_add (nile_Real_mul (r, nile_Real (255)), nile_Real (0.5)));
+}
+
+/* Operators whose result is B wherever A is transparent */
+static const char gezira_composite_keeps_dst[GEZIRA_COMPOSITE_NOPS] = {
+    0, 0, 1, 1, 1, 0, 0, 0, 1, 1, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0
+};
+
+/* D = A op B, channel by channel as the Color arithmetic in compositor.nl */
+static void
+gezira_composite (int op, const float *A, const float *B, float *D)
+{
+    float a = A[0], b = B[0];
+    int   i;
+
+    for (i = 0; i < 4; i++) {
+        float x  = A[i], y = B[i];
+        float xr = x * (1 - b) + y * (1 - a);
+        float d  = 0;
+        switch (op) {
+            case GEZIRA_COMPOSITE_CLEAR:    d = 0;                          break;
+            case GEZIRA_COMPOSITE_SRC:      d = x;                          break;
+            case GEZIRA_COMPOSITE_DST:      d = y;                          break;
+            case GEZIRA_COMPOSITE_OVER:     d = x + y * (1 - a);            break;
+            case GEZIRA_COMPOSITE_DST_OVER: d = y + x * (1 - b);            break;
+            case GEZIRA_COMPOSITE_SRC_IN:   d = x * b;                      break;
+            case GEZIRA_COMPOSITE_DST_IN:   d = y * a;                      break;
+            case GEZIRA_COMPOSITE_SRC_OUT:  d = x * (1 - b);                break;
+            case GEZIRA_COMPOSITE_DST_OUT:  d = y * (1 - a);                break;
+            case GEZIRA_COMPOSITE_SRC_ATOP: d = x * b + y * (1 - a);        break;
+            case GEZIRA_COMPOSITE_DST_ATOP: d = y * a + x * (1 - b);        break;
+            case GEZIRA_COMPOSITE_XOR:      d = xr;                         break;
+            case GEZIRA_COMPOSITE_PLUS:     d = x + y < 1 ? x + y : 1;      break;
+            case GEZIRA_COMPOSITE_MULTIPLY: d = x * y + xr;                 break;
+            case GEZIRA_COMPOSITE_SCREEN:   d = x + y - x * y;              break;
+            case GEZIRA_COMPOSITE_OVERLAY:
+                d = 2 * y < b ? 2 * x * y + xr : a * b - 2 * (b - y) * (a - x) + xr;
+                break;
+            case GEZIRA_COMPOSITE_DARKEN:
+                d = (x * b < y * a ? x * b : y * a) + xr;
+                break;
+            case GEZIRA_COMPOSITE_LIGHTEN:
+                d = (x * b > y * a ? x * b : y * a) + xr;
+                break;
+            case GEZIRA_COMPOSITE_COLOR_DODGE:
+                if (x * b + y * a >= a * b)
+                    d = a * b + xr;
+                else {
+                    d = y * a / (1 - x / a) + xr;
+                    d = d < 1 ? d : 1;
+                }
+                break;
+            case GEZIRA_COMPOSITE_COLOR_BURN:
+                d = x * b + y * a <= a * b ? xr : a * (x * b + y * a - a * b) / x + xr;
+                break;
+            case GEZIRA_COMPOSITE_HARD_LIGHT:
+                d = 2 * x < a ? 2 * x * y + xr : a * b - 2 * (b - y) * (a - x) + xr;
+                break;
+            case GEZIRA_COMPOSITE_SOFT_LIGHT: {
+                float yb = b > 0 ? y / b : 0;
+                float c  = (1 - yb) * (2 * x - a);
+                d = 2 * x < a ? y * (a - c) + xr :
+                    8 * y <= b ? y * (a - c * (3 - 8 * yb)) + xr :
+                                 y * a + (sqrtf (yb) * b - y) * (2 * x - a) + xr;
+                break;
+            }
+            case GEZIRA_COMPOSITE_DIFFERENCE:
+                d = x + y - 2 * (x * b < y * a ? x * b : y * a);
+                break;
+            case GEZIRA_COMPOSITE_EXCLUSION:
+                d = x * b + y * a - 2 * x * y + xr;
+                break;
+            case GEZIRA_COMPOSITE_SUBTRACT:
+                d = x + y - 1 > 0 ? x + y - 1 : 0;
+                break;
+            case GEZIRA_COMPOSITE_INVERT:
+                d = i ? 1 - y : y;
+                break;
+        }
+        D[i] = d;
+    }
+    if (op == GEZIRA_COMPOSITE_DIFFERENCE || op == GEZIRA_COMPOSITE_EXCLUSION)
+        D[0] += a * b;
+}
+
+void
+gezira_Paint_init_uniform (gezira_Paint_t *paint, float a, float r, float g, float b)
+{
+    paint->kind     = GEZIRA_PAINT_UNIFORM;
+    paint->color[0] = a;
+    paint->color[1] = a * r;
+    paint->color[2] = a * g;
+    paint->color[3] = a * b;
+    paint->texture  = NULL;
+}
+
+void
+gezira_Paint_init_texture (gezira_Paint_t *paint, gezira_Texture_t *texture, int bilinear)
+{
+    gezira_Paint_init_uniform (paint, 0, 0, 0, 0);
+    paint->kind    = bilinear ? GEZIRA_PAINT_TEXTURE_BILINEAR : GEZIRA_PAINT_TEXTURE;
+    paint->texture = texture;
+}
+
+/* A paint as captured by a process, sampled like gezira_ReadFromTexture */
+typedef struct {
+    int          kind;
+    float        color[4];
+    const float *texels;
+    int          stride;
+    float        width, height;
+} gezira_Paint_sampler_t;
+
+static int
+gezira_Paint_sampler_init (gezira_Paint_sampler_t *s, nile_Process_t *parent, gezira_Paint_t *paint)
+{
+    int i;
+    s->kind = paint->kind;
+    for (i = 0; i < 4; i++)
+        s->color[i] = paint->color[i];
+    if (paint->kind == GEZIRA_PAINT_UNIFORM)
+        return 1;
+    if (!gezira_Texture_prepare (parent, paint->texture))
+        return 0;
+    s->texels = paint->texture->texels;
+    s->stride = paint->texture->texels_stride * 4;
+    s->width  = paint->texture->levels[0].width;
+    s->height = paint->texture->levels[0].height;
+    return 1;
+}
+
+/* Texels are only read once the process filling them has finished, which
+   a pass-through sequenced on the texture's source waits for */
+static nile_Process_t *
+gezira_Paint_sequence (nile_Process_t *parent, nile_Process_t *p, gezira_Paint_t *paint)
+{
+    nile_Process_t *wait;
+    if (!p || !paint->texture)
+        return p;
+    wait = nile_Identity (parent, 1);
+    if (!wait)
+        return NULL;
+    wait = gezira_Image_sequence (parent, wait, paint->texture->source, 0);
+    return nile_Process_pipe (wait, p, NILE_NULL);
+}
+
+static inline void
+gezira_Paint_sample (const gezira_Paint_sampler_t *s, float x, float y, float *C)
+{
+    if (s->kind == GEZIRA_PAINT_UNIFORM) {
+        C[0] = s->color[0]; C[1] = s->color[1];
+        C[2] = s->color[2]; C[3] = s->color[3];
+    }
+    else if (s->kind == GEZIRA_PAINT_TEXTURE) {
+        float xmax = s->width  - 0.5f;
+        float ymax = s->height - 0.5f;
+        x = x < 0 ? 0 : x > xmax ? xmax : x;
+        y = y < 0 ? 0 : y > ymax ? ymax : y;
+        const float *t = s->texels + ((int) y + 1) * s->stride + ((int) x + 1) * 4;
+        C[0] = t[0]; C[1] = t[1]; C[2] = t[2]; C[3] = t[3];
+    }
+    else {
+        x = (x < 0 ? 0 : x > s->width  ? s->width  : x) + 0.5f;
+        y = (y < 0 ? 0 : y > s->height ? s->height : y) + 0.5f;
+        int   x0 = x;
+        int   y0 = y;
+        float u  = x - x0;
+        float w  = y - y0;
+        const float *t0 = s->texels + y0 * s->stride + x0 * 4;
+        const float *t1 = t0 + s->stride;
+        float w00 = (1 - u) * (1 - w), w01 = u * (1 - w);
+        float w10 = (1 - u) * w,       w11 = u * w;
+        int   i;
+        for (i = 0; i < 4; i++)
+            C[i] = w00 * t0[i] + w01 * t0[i + 4] + w10 * t1[i] + w11 * t1[i + 4];
+    }
+}
+
+typedef struct {
+    gezira_Paint_sampler_t t1, t2;
+    int                    op;
+} gezira_CompositePaints_vars_t;
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_CompositePaints_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_CompositePaints_vars_t *v = nile_Process_vars (p);
+    int op = v->op;
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in));
+            float y = nile_Real_tof (nile_Buffer_pop_head (in));
+            float A[4], B[4], D[4];
+            const float *C = D;
+            if (op == GEZIRA_COMPOSITE_DST) {
+                gezira_Paint_sample (&v->t2, x, y, B);
+                C = B;
+            }
+            else {
+                gezira_Paint_sample (&v->t1, x, y, A);
+                if (op == GEZIRA_COMPOSITE_SRC || (op == GEZIRA_COMPOSITE_OVER && A[0] >= 1))
+                    C = A;
+                else {
+                    gezira_Paint_sample (&v->t2, x, y, B);
+                    if (A[0] <= 0 && gezira_composite_keeps_dst[op])
+                        C = B;
+                    else
+                        gezira_composite (op, A, B, D);
+                }
+            }
+            nile_Buffer_push_tail (out, nile_Real (C[0])); nile_Buffer_push_tail (out, nile_Real (C[1]));
+            nile_Buffer_push_tail (out, nile_Real (C[2])); nile_Buffer_push_tail (out, nile_Real (C[3]));
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_CompositePaints_body)
+
+nile_Process_t *
+gezira_CompositePaints (nile_Process_t *p, gezira_Paint_t *t1, gezira_Paint_t *t2, int op)
+{
+    gezira_CompositePaints_vars_t *vars;
+    gezira_Paint_sampler_t s1, s2;
+    nile_Process_t *parent = p;
+    if (op < 0 || op >= GEZIRA_COMPOSITE_NOPS ||
+        !gezira_Paint_sampler_init (&s1, parent, t1) || !gezira_Paint_sampler_init (&s2, parent, t2))
+        return NULL;
+    p = nile_Process (p, 2, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_CompositePaints_body), NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->t1 = s1;
+        vars->t2 = s2;
+        vars->op = op;
+        p = gezira_Paint_sequence (parent, p, t1);
+        if (t2->texture && (!t1->texture || t2->texture->source != t1->texture->source))
+            p = gezira_Paint_sequence (parent, p, t2);
+    }
+    return p;
+}
+
+/* 8-bit premultiplied blending. x, y are a channel of the source and
+   destination and a, b their alphas, all 0..255; each operator follows the
+   float one above with products rounded through gezira_div255. */
+
+static inline int
+gezira_div255 (int v)
+{
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+#define GEZIRA_XR (x * (255 - b) + y * (255 - a))
+
+static inline int gezira_blend_clear    (int x, int y, int a, int b) { return 0; }
+static inline int gezira_blend_src      (int x, int y, int a, int b) { return x; }
+static inline int gezira_blend_dst      (int x, int y, int a, int b) { return y; }
+static inline int gezira_blend_over     (int x, int y, int a, int b) { return x + gezira_div255 (y * (255 - a)); }
+static inline int gezira_blend_dst_over (int x, int y, int a, int b) { return y + gezira_div255 (x * (255 - b)); }
+static inline int gezira_blend_src_in   (int x, int y, int a, int b) { return gezira_div255 (x * b); }
+static inline int gezira_blend_dst_in   (int x, int y, int a, int b) { return gezira_div255 (y * a); }
+static inline int gezira_blend_src_out  (int x, int y, int a, int b) { return gezira_div255 (x * (255 - b)); }
+static inline int gezira_blend_dst_out  (int x, int y, int a, int b) { return gezira_div255 (y * (255 - a)); }
+static inline int gezira_blend_src_atop (int x, int y, int a, int b) { return gezira_div255 (x * b + y * (255 - a)); }
+static inline int gezira_blend_dst_atop (int x, int y, int a, int b) { return gezira_div255 (y * a + x * (255 - b)); }
+static inline int gezira_blend_xor      (int x, int y, int a, int b) { return gezira_div255 (GEZIRA_XR); }
+static inline int gezira_blend_plus     (int x, int y, int a, int b) { return x + y < 255 ? x + y : 255; }
+static inline int gezira_blend_multiply (int x, int y, int a, int b) { return gezira_div255 (x * y + GEZIRA_XR); }
+static inline int gezira_blend_screen   (int x, int y, int a, int b) { return x + y - gezira_div255 (x * y); }
+static inline int gezira_blend_subtract (int x, int y, int a, int b) { return x + y > 255 ? x + y - 255 : 0; }
+
+static inline int
+gezira_blend_hard (int x, int y, int a, int b, int low)
+{
+    int d = low ? 2 * x * y : a * b - 2 * (b - y) * (a - x);
+    d = gezira_div255 (d + GEZIRA_XR);
+    return d < 0 ? 0 : d > 255 ? 255 : d;
+}
+
+static inline int gezira_blend_overlay    (int x, int y, int a, int b) { return gezira_blend_hard (x, y, a, b, 2 * y < b); }
+static inline int gezira_blend_hard_light (int x, int y, int a, int b) { return gezira_blend_hard (x, y, a, b, 2 * x < a); }
+
+static inline int
+gezira_blend_darken (int x, int y, int a, int b)
+{
+    return gezira_div255 ((x * b < y * a ? x * b : y * a) + GEZIRA_XR);
+}
+
+static inline int
+gezira_blend_lighten (int x, int y, int a, int b)
+{
+    return gezira_div255 ((x * b > y * a ? x * b : y * a) + GEZIRA_XR);
+}
+
+static inline int
+gezira_blend_color_dodge (int x, int y, int a, int b)
+{
+    int d;
+    if (x * b + y * a >= a * b)
+        return gezira_div255 (a * b + GEZIRA_XR);
+    d = y * a * a / (255 * (a - x)) + gezira_div255 (GEZIRA_XR);
+    return d < 255 ? d : 255;
+}
+
+static inline int
+gezira_blend_color_burn (int x, int y, int a, int b)
+{
+    int d;
+    if (x * b + y * a <= a * b)
+        return gezira_div255 (GEZIRA_XR);
+    d = a * (x * b + y * a - a * b) / (255 * x) + gezira_div255 (GEZIRA_XR);
+    return d < 255 ? d : 255;
+}
+
+static inline int
+gezira_blend_soft_light (int x, int y, int a, int b)
+{
+    float A[4] = {a / 255.0f, x / 255.0f, 0, 0};
+    float B[4] = {b / 255.0f, y / 255.0f, 0, 0};
+    float D[4];
+    gezira_composite (GEZIRA_COMPOSITE_SOFT_LIGHT, A, B, D);
+    D[1] = D[1] < 0 ? 0 : D[1] > 1 ? 1 : D[1];
+    return D[1] * 255 + 0.5f;
+}
+
+static inline int
+gezira_blend_difference (int x, int y, int a, int b)
+{
+    return x + y - 2 * gezira_div255 (x * b < y * a ? x * b : y * a);
+}
+
+static inline int
+gezira_blend_exclusion (int x, int y, int a, int b)
+{
+    int d = gezira_div255 (x * b + y * a - 2 * x * y + GEZIRA_XR);
+    return d < 0 ? 0 : d;
+}
+
+static inline int gezira_blend_invert (int x, int y, int a, int b) { return 255 - y; }
+
+static inline int gezira_blend_union_alpha (int x, int y, int a, int b) { return a + b - gezira_div255 (a * b); }
+
+#undef GEZIRA_XR
+
+/* One loop per operator, with the operator's alpha and color functions
+   inlined so the compiler can vectorize it. Coverage c blends the result
+   with the destination. */
+#define GEZIRA_BLEND_ROW(alpha_fn, color_fn) \
+    for (i = 0; i < n; i++) { \
+        uint32_t S = src[i], D = dst[i]; \
+        int a  = S >> 24,         b  = D >> 24; \
+        int xr = (S >> 16) & 0xff, yr = (D >> 16) & 0xff; \
+        int xg = (S >>  8) & 0xff, yg = (D >>  8) & 0xff; \
+        int xb = (S >>  0) & 0xff, yb = (D >>  0) & 0xff; \
+        int da = alpha_fn (a,  b,  a, b); \
+        int dr = color_fn (xr, yr, a, b); \
+        int dg = color_fn (xg, yg, a, b); \
+        int db = color_fn (xb, yb, a, b); \
+        if (c != 255) { \
+            da = gezira_div255 (da * c + b  * ic); \
+            dr = gezira_div255 (dr * c + yr * ic); \
+            dg = gezira_div255 (dg * c + yg * ic); \
+            db = gezira_div255 (db * c + yb * ic); \
+        } \
+        dst[i] = (uint32_t) da << 24 | (uint32_t) dr << 16 | (uint32_t) dg << 8 | (uint32_t) db; \
+    } \
+    break;
+
+GEZIRA_KERNEL void
+gezira_blend_row (int op, uint32_t *dst, const uint32_t *src, int n, int c)
+{
+    int ic = 255 - c;
+    int i;
+    switch (op) {
+        case GEZIRA_COMPOSITE_CLEAR:       GEZIRA_BLEND_ROW (gezira_blend_clear,       gezira_blend_clear)
+        case GEZIRA_COMPOSITE_SRC:         GEZIRA_BLEND_ROW (gezira_blend_src,         gezira_blend_src)
+        case GEZIRA_COMPOSITE_DST:         break;
+        case GEZIRA_COMPOSITE_OVER:        GEZIRA_BLEND_ROW (gezira_blend_over,        gezira_blend_over)
+        case GEZIRA_COMPOSITE_DST_OVER:    GEZIRA_BLEND_ROW (gezira_blend_dst_over,    gezira_blend_dst_over)
+        case GEZIRA_COMPOSITE_SRC_IN:      GEZIRA_BLEND_ROW (gezira_blend_src_in,      gezira_blend_src_in)
+        case GEZIRA_COMPOSITE_DST_IN:      GEZIRA_BLEND_ROW (gezira_blend_dst_in,      gezira_blend_dst_in)
+        case GEZIRA_COMPOSITE_SRC_OUT:     GEZIRA_BLEND_ROW (gezira_blend_src_out,     gezira_blend_src_out)
+        case GEZIRA_COMPOSITE_DST_OUT:     GEZIRA_BLEND_ROW (gezira_blend_dst_out,     gezira_blend_dst_out)
+        case GEZIRA_COMPOSITE_SRC_ATOP:    GEZIRA_BLEND_ROW (gezira_blend_src_atop,    gezira_blend_src_atop)
+        case GEZIRA_COMPOSITE_DST_ATOP:    GEZIRA_BLEND_ROW (gezira_blend_dst_atop,    gezira_blend_dst_atop)
+        case GEZIRA_COMPOSITE_XOR:         GEZIRA_BLEND_ROW (gezira_blend_xor,         gezira_blend_xor)
+        case GEZIRA_COMPOSITE_PLUS:        GEZIRA_BLEND_ROW (gezira_blend_plus,        gezira_blend_plus)
+        case GEZIRA_COMPOSITE_MULTIPLY:    GEZIRA_BLEND_ROW (gezira_blend_multiply,    gezira_blend_multiply)
+        case GEZIRA_COMPOSITE_SCREEN:      GEZIRA_BLEND_ROW (gezira_blend_screen,      gezira_blend_screen)
+        case GEZIRA_COMPOSITE_OVERLAY:     GEZIRA_BLEND_ROW (gezira_blend_overlay,     gezira_blend_overlay)
+        case GEZIRA_COMPOSITE_DARKEN:      GEZIRA_BLEND_ROW (gezira_blend_darken,      gezira_blend_darken)
+        case GEZIRA_COMPOSITE_LIGHTEN:     GEZIRA_BLEND_ROW (gezira_blend_lighten,     gezira_blend_lighten)
+        case GEZIRA_COMPOSITE_COLOR_DODGE: GEZIRA_BLEND_ROW (gezira_blend_color_dodge, gezira_blend_color_dodge)
+        case GEZIRA_COMPOSITE_COLOR_BURN:  GEZIRA_BLEND_ROW (gezira_blend_color_burn,  gezira_blend_color_burn)
+        case GEZIRA_COMPOSITE_HARD_LIGHT:  GEZIRA_BLEND_ROW (gezira_blend_hard_light,  gezira_blend_hard_light)
+        case GEZIRA_COMPOSITE_SOFT_LIGHT:  GEZIRA_BLEND_ROW (gezira_blend_soft_light,  gezira_blend_soft_light)
+        case GEZIRA_COMPOSITE_DIFFERENCE:  GEZIRA_BLEND_ROW (gezira_blend_union_alpha, gezira_blend_difference)
+        case GEZIRA_COMPOSITE_EXCLUSION:   GEZIRA_BLEND_ROW (gezira_blend_union_alpha, gezira_blend_exclusion)
+        case GEZIRA_COMPOSITE_SUBTRACT:    GEZIRA_BLEND_ROW (gezira_blend_subtract,    gezira_blend_subtract)
+        case GEZIRA_COMPOSITE_INVERT:      GEZIRA_BLEND_ROW (gezira_blend_dst,         gezira_blend_invert)
+    }
+}
+
+#undef GEZIRA_BLEND_ROW
+
+#ifdef GEZIRA_TARGET_AVX2
+static void GEZIRA_TARGET_AVX2
+gezira_blend_row_avx2 (int op, uint32_t *dst, const uint32_t *src, int n, int c)
+{
+    gezira_blend_row (op, dst, src, n, c);
+}
+
+static void GEZIRA_TARGET_AVX512
+gezira_blend_row_avx512 (int op, uint32_t *dst, const uint32_t *src, int n, int c)
+{
+    gezira_blend_row (op, dst, src, n, c);
+}
+#endif
+
+void
+gezira_BlendRow_ARGB32 (int op, uint32_t *dst, const uint32_t *src, int n, int c)
+{
+#ifdef GEZIRA_TARGET_AVX2
+    int level = gezira_cpu_level ();
+    if (level >= GEZIRA_CPU_AVX512)
+        gezira_blend_row_avx512 (op, dst, src, n, c);
+    else if (level >= GEZIRA_CPU_AVX2)
+        gezira_blend_row_avx2 (op, dst, src, n, c);
+    else
+#endif
+        gezira_blend_row (op, dst, src, n, c);
+}
+
+#define GEZIRA_BLEND_CHUNK 256
+
+typedef struct {
+    gezira_Image_t  image;
+    int             op;
+    int             opacity;
+    uint32_t        color;
+    gezira_Image_t  source;
+    int             sx, sy;
+    float           rect[4];
+    gezira_Paint_sampler_t bilinear;
+} gezira_CompositeIntoImage_ARGB32_vars_t;
+
+static void
+gezira_CompositeIntoImage_ARGB32_span (gezira_CompositeIntoImage_ARGB32_vars_t *v, uint32_t *row,
+                                       int x, int y, uint8_t c, int l)
+{
+    uint32_t *pixels = v->image.pixels;
+    int       stride = v->image.stride;
+    int       i;
+
+    c = gezira_div255 (c * v->opacity);
+    while (l > 0) {
+        int k = l < GEZIRA_BLEND_CHUNK ? l : GEZIRA_BLEND_CHUNK;
+        const uint32_t *src = row;
+        if (v->source.pixels) {
+            int sw = v->source.width;
+            int sh = v->source.height;
+            int sx = x - v->sx;
+            int sy = y - v->sy;
+            uint32_t *srow;
+            sy = sy < 0 ? 0 : sy < sh ? sy : sh - 1;
+            srow = (uint32_t *) v->source.pixels + sy * v->source.stride;
+            if (sx >= 0 && sx + k <= sw)
+                src = srow + sx;
+            else
+                for (i = 0; i < k; i++)
+                    row[i] = srow[sx + i < 0 ? 0 : sx + i < sw ? sx + i : sw - 1];
+        }
+        else if (v->bilinear.kind == GEZIRA_PAINT_TEXTURE_BILINEAR) {
+            for (i = 0; i < k; i++) {
+                float C[4];
+                gezira_Paint_sample (&v->bilinear, x + i + 0.5f, y + 0.5f, C);
+                row[i] = (uint32_t) (C[0] * 255 + 0.5f) << 24 | (uint32_t) (C[1] * 255 + 0.5f) << 16 |
+                         (uint32_t) (C[2] * 255 + 0.5f) <<  8 | (uint32_t) (C[3] * 255 + 0.5f);
+            }
+        }
+        gezira_BlendRow_ARGB32 (v->op, pixels + x + y * stride, src, k, c);
+        x += k;
+        l -= k;
+    }
+}
+
+static void
+gezira_CompositeIntoImage_ARGB32_row (gezira_CompositeIntoImage_ARGB32_vars_t *v, uint32_t *row)
+{
+    int i;
+    if (!v->source.pixels && v->bilinear.kind == GEZIRA_PAINT_UNIFORM)
+        for (i = 0; i < GEZIRA_BLEND_CHUNK; i++)
+            row[i] = v->color;
+}
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_CompositeIntoImage_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_CompositeIntoImage_ARGB32_vars_t *v = nile_Process_vars (p);
+    int       width  = v->image.width;
+    int       height = v->image.height;
+    uint32_t  row[GEZIRA_BLEND_CHUNK];
+
+    gezira_CompositeIntoImage_ARGB32_row (v, row);
+    while (!nile_Buffer_is_empty (in)) {
+        int     x = nile_Real_toi (nile_Buffer_pop_head (in));
+        int     y = nile_Real_toi (nile_Buffer_pop_head (in));
+        uint8_t c = Real_to_uint8_t (nile_Buffer_pop_head (in));
+        int     l = nile_Real_toi (nile_Buffer_pop_head (in));
+
+        if (c == 0 || l <= 0          ||
+            x <  0 || width  <  x + l ||
+            y <  0 || height <= y)
+            continue;
+        gezira_CompositeIntoImage_ARGB32_span (v, row, x, y, c, l);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_CompositeIntoImage_ARGB32_body)
+
+/* Each row of the rectangle, clipped to the image, is a partly covered
+   pixel at either end and a run between them at the row's coverage */
+static nile_Buffer_t *
+gezira_CompositeRectIntoImage_ARGB32_prologue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_CompositeIntoImage_ARGB32_vars_t *v = nile_Process_vars (p);
+    float    min_x = v->rect[0] > 0 ? v->rect[0] : 0;
+    float    min_y = v->rect[1] > 0 ? v->rect[1] : 0;
+    float    max_x = v->rect[2] < v->image.width  ? v->rect[2] : v->image.width;
+    float    max_y = v->rect[3] < v->image.height ? v->rect[3] : v->image.height;
+    int      x0 = floorf (min_x), x1 = ceilf (max_x) - 1;
+    int      y, y1 = ceilf (max_y);
+    uint32_t row[GEZIRA_BLEND_CHUNK];
+
+    if (!(min_x < max_x && min_y < max_y))
+        return out;
+    gezira_CompositeIntoImage_ARGB32_row (v, row);
+    for (y = floorf (min_y); y < y1; y++) {
+        float cy = (y + 1 < max_y ? y + 1 : max_y) - (y > min_y ? y : min_y);
+        uint8_t c;
+        if (x0 == x1) {
+            if ((c = (max_x - min_x) * cy * 255 + 0.5f))
+                gezira_CompositeIntoImage_ARGB32_span (v, row, x0, y, c, 1);
+            continue;
+        }
+        if ((c = (x0 + 1 - min_x) * cy * 255 + 0.5f))
+            gezira_CompositeIntoImage_ARGB32_span (v, row, x0, y, c, 1);
+        if ((c = cy * 255 + 0.5f) && x1 > x0 + 1)
+            gezira_CompositeIntoImage_ARGB32_span (v, row, x0 + 1, y, c, x1 - x0 - 1);
+        if ((c = (max_x - x1) * cy * 255 + 0.5f))
+            gezira_CompositeIntoImage_ARGB32_span (v, row, x1, y, c, 1);
+    }
+    return out;
+}
+
+static nile_Process_t *
+gezira_CompositeIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int op, float opacity,
+                                  uint32_t color, gezira_Image_t *source, int sx, int sy,
+                                  const float *rect, const gezira_Paint_sampler_t *bilinear)
+{
+    gezira_CompositeIntoImage_ARGB32_vars_t *vars;
+    nile_Process_t *parent = p;
+    if (op < 0 || op >= GEZIRA_COMPOSITE_NOPS)
+        return NULL;
+    p = nile_Process (p, 4, sizeof (*vars),
+                      rect ? gezira_CompositeRectIntoImage_ARGB32_prologue : NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_CompositeIntoImage_ARGB32_body), NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->image   = *image;
+        vars->op      = op;
+        vars->opacity = opacity * 255 + 0.5f;
+        vars->color   = color;
+        if (source)
+            vars->source = *source;
+        else
+            vars->source.pixels = NULL;
+        vars->sx = sx;
+        vars->sy = sy;
+        if (rect)
+            memcpy (vars->rect, rect, sizeof (vars->rect));
+        if (bilinear)
+            vars->bilinear = *bilinear;
+        else
+            vars->bilinear.kind = GEZIRA_PAINT_UNIFORM;
+        p = gezira_Image_sequence (parent, p, image, 0);
+        image->version++;
+    }
+    return p;
+}
+
+static uint32_t
+gezira_Paint_color_ARGB32 (gezira_Paint_t *paint)
+{
+    return (uint32_t) (paint->color[0] * 255 + 0.5f) << 24 |
+           (uint32_t) (paint->color[1] * 255 + 0.5f) << 16 |
+           (uint32_t) (paint->color[2] * 255 + 0.5f) <<  8 |
+           (uint32_t) (paint->color[3] * 255 + 0.5f);
+}
+
+/* Texture paints are sampled at pixel centers: nearest ones straight from
+   the source pixels, bilinear ones from the texels. Either way the paint's
+   source is read after its earlier writers finish. */
+static nile_Process_t *
+gezira_CompositePaintIntoImage_ (nile_Process_t *p, gezira_Image_t *image,
+                                 gezira_Paint_t *paint, int op, const float *rect)
+{
+    nile_Process_t *parent = p;
+    gezira_Image_t *source = paint->kind == GEZIRA_PAINT_TEXTURE ? &paint->texture->levels[0] : NULL;
+    gezira_Paint_sampler_t bilinear;
+    if (paint->kind == GEZIRA_PAINT_TEXTURE_BILINEAR &&
+        !gezira_Paint_sampler_init (&bilinear, parent, paint))
+        return NULL;
+    p = gezira_CompositeIntoImage_ARGB32 (parent, image, op, 1, gezira_Paint_color_ARGB32 (paint),
+                                          source, 0, 0, rect,
+                                          paint->kind == GEZIRA_PAINT_TEXTURE_BILINEAR ? &bilinear : NULL);
+    return gezira_Paint_sequence (parent, p, paint);
+}
+
+nile_Process_t *
+gezira_CompositePaintIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                       gezira_Paint_t *paint, int op)
+{
+    return gezira_CompositePaintIntoImage_ (p, image, paint, op, NULL);
+}
+
+nile_Process_t *
+gezira_CompositeRectIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                      gezira_Paint_t *paint, int op,
+                                      float min_x, float min_y, float max_x, float max_y)
+{
+    float rect[4] = {min_x, min_y, max_x, max_y};
+    return gezira_CompositePaintIntoImage_ (p, image, paint, op, rect);
+}
+
+/* The source is read after its earlier writers finish, but is not itself
+   gated: nothing should write it while it is being composited. */
+nile_Process_t *
+gezira_CompositeImageIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                       gezira_Image_t *source, int sx, int sy,
+                                       float opacity, int op)
+{
+    nile_Process_t *parent = p;
+    nile_Process_t *wait = nile_Identity (p, 4);
+    p = gezira_CompositeIntoImage_ARGB32 (parent, image, op, opacity, 0, source, sx, sy, NULL, NULL);
+    if (!wait || !p) {
+        /* An unfed composite would hold up the image's later users */
+        if (wait)
+            nile_Process_feed (wait, NULL, 0);
+        if (p)
+            nile_Process_feed (p, NULL, 0);
+        return NULL;
+    }
+    wait = gezira_Image_sequence (parent, wait, source, 1);
+    return nile_Process_pipe (wait, p, NILE_NULL);
+}
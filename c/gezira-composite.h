@@ -0,0 +1,85 @@
+#ifndef GEZIRA_COMPOSITE_H
+#define GEZIRA_COMPOSITE_H
+
+#include <stdint.h>
+#include "nile.h"
+#include "gezira-texture.h"
+
+/* Compositing operators, as in compositor.nl */
+#define GEZIRA_COMPOSITE_CLEAR        0
+#define GEZIRA_COMPOSITE_SRC          1
+#define GEZIRA_COMPOSITE_DST          2
+#define GEZIRA_COMPOSITE_OVER         3
+#define GEZIRA_COMPOSITE_DST_OVER     4
+#define GEZIRA_COMPOSITE_SRC_IN       5
+#define GEZIRA_COMPOSITE_DST_IN       6
+#define GEZIRA_COMPOSITE_SRC_OUT      7
+#define GEZIRA_COMPOSITE_DST_OUT      8
+#define GEZIRA_COMPOSITE_SRC_ATOP     9
+#define GEZIRA_COMPOSITE_DST_ATOP    10
+#define GEZIRA_COMPOSITE_XOR         11
+#define GEZIRA_COMPOSITE_PLUS        12
+#define GEZIRA_COMPOSITE_MULTIPLY    13
+#define GEZIRA_COMPOSITE_SCREEN      14
+#define GEZIRA_COMPOSITE_OVERLAY     15
+#define GEZIRA_COMPOSITE_DARKEN      16
+#define GEZIRA_COMPOSITE_LIGHTEN     17
+#define GEZIRA_COMPOSITE_COLOR_DODGE 18
+#define GEZIRA_COMPOSITE_COLOR_BURN  19
+#define GEZIRA_COMPOSITE_HARD_LIGHT  20
+#define GEZIRA_COMPOSITE_SOFT_LIGHT  21
+#define GEZIRA_COMPOSITE_DIFFERENCE  22
+#define GEZIRA_COMPOSITE_EXCLUSION   23
+#define GEZIRA_COMPOSITE_SUBTRACT    24
+#define GEZIRA_COMPOSITE_INVERT      25
+#define GEZIRA_COMPOSITE_NOPS        26
+
+#define GEZIRA_PAINT_UNIFORM          0
+#define GEZIRA_PAINT_TEXTURE          1
+#define GEZIRA_PAINT_TEXTURE_BILINEAR 2
+
+/* A texture that can be sampled in place, without a process of its own */
+typedef struct {
+    int               kind;
+    float             color[4];
+    gezira_Texture_t *texture;
+} gezira_Paint_t;
+
+void
+gezira_Paint_init_uniform (gezira_Paint_t *paint, float a, float r, float g, float b);
+
+void
+gezira_Paint_init_texture (gezira_Paint_t *paint, gezira_Texture_t *texture, int bilinear);
+
+/* CompositeTextures (t1, t2, c) for paints: both are sampled at each point
+   and composited in one pass, without DupZip. */
+nile_Process_t *
+gezira_CompositePaints (nile_Process_t *p, gezira_Paint_t *t1, gezira_Paint_t *t2, int op);
+
+/* Blends n source pixels into dst with op at coverage c (0..255) */
+void
+gezira_BlendRow_ARGB32 (int op, uint32_t *dst, const uint32_t *src, int n, int c);
+
+/* Consumes CoverageSpans like CompositeUniformColorOverImage_ARGB32. A
+   texture paint is read pixel for pixel from its source image, clamped to
+   its edge. */
+nile_Process_t *
+gezira_CompositePaintIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                       gezira_Paint_t *paint, int op);
+
+/* Composites the paint over an axis-aligned rectangle, with fractional
+   edges, straight from its rows rather than through spans. Feed the
+   result with no input. */
+nile_Process_t *
+gezira_CompositeRectIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                      gezira_Paint_t *paint, int op,
+                                      float min_x, float min_y, float max_x, float max_y);
+
+/* Consumes CoverageSpans, blending the source pixel at (x - sx, y - sy)
+   into each covered destination pixel, scaled by opacity. */
+nile_Process_t *
+gezira_CompositeImageIntoImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                       gezira_Image_t *source, int sx, int sy,
+                                       float opacity, int op);
+
+#endif
@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gezira-cpu.h"
+
+static int gezira_cpu_supported = -1;
+static int gezira_cpu_default;
+static int gezira_cpu_forced = -1;
+
+static int
+gezira_cpu_detect (void)
+{
+#if defined (GEZIRA_DISPATCH) && defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx512f")  && __builtin_cpu_supports ("avx512bw") &&
+        __builtin_cpu_supports ("avx512dq") && __builtin_cpu_supports ("avx512vl") &&
+        __builtin_cpu_supports ("avx2")     && __builtin_cpu_supports ("fma"))
+        return GEZIRA_CPU_AVX512;
+    if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+        return GEZIRA_CPU_AVX2;
+#endif
+    return GEZIRA_CPU_SSE2;
+}
+
+/* Runs once before main where the compiler has constructors, so processes
+   made from several threads never see a half-set level. Elsewhere the
+   first gezira_cpu_level runs it, and there is only the SSE2 build. */
+#ifdef __GNUC__
+__attribute__ ((constructor))
+#endif
+static void
+gezira_cpu_init (void)
+{
+    const char *s = getenv ("GEZIRA_CPU");
+    int level = gezira_cpu_detect ();
+    gezira_cpu_default = level;
+    if (s && !strcmp (s, "sse2"))
+        gezira_cpu_default = GEZIRA_CPU_SSE2;
+    else if (s && !strcmp (s, "avx2"))
+        gezira_cpu_default = GEZIRA_CPU_AVX2;
+    else if (s && !strcmp (s, "avx512"))
+        gezira_cpu_default = GEZIRA_CPU_AVX512;
+    gezira_cpu_supported = level;
+}
+
+int
+gezira_cpu_level (void)
+{
+    int level;
+#ifndef __GNUC__
+    if (gezira_cpu_supported < 0)
+        gezira_cpu_init ();
+#endif
+    level = gezira_cpu_forced < 0 ? gezira_cpu_default : gezira_cpu_forced;
+    return level < gezira_cpu_supported ? level : gezira_cpu_supported;
+}
+
+void
+gezira_cpu_force (int level)
+{
+    gezira_cpu_forced = level;
+}
+
+#ifdef GEZIRA_DISPATCH_LEVELS
+
+/* Makefile.gcc builds gezira.c once per level, with each constructor
+   renamed name_sse2, name_avx2 and name_avx512. Each process made here
+   runs the build for gezira_cpu_level at the time. */
+#include "gezira.h"
+
+#define GEZIRA_LEVELS(name, params, args) \
+    nile_Process_t *name##_sse2 params; \
+    nile_Process_t *name##_avx2 params; \
+    nile_Process_t *name##_avx512 params; \
+    nile_Process_t * \
+    name params \
+    { \
+        int level = gezira_cpu_level (); \
+        return level >= GEZIRA_CPU_AVX512 ? name##_avx512 args : \
+               level >= GEZIRA_CPU_AVX2   ? name##_avx2   args : name##_sse2 args; \
+    }
+
+GEZIRA_LEVELS (gezira_TransformBeziers,
+               (nile_Process_t *p, float v_M_a, float v_M_b, float v_M_c, float v_M_d, float v_M_e,
+                float v_M_f),
+               (p, v_M_a, v_M_b, v_M_c, v_M_d, v_M_e, v_M_f))
+GEZIRA_LEVELS (gezira_ClipBeziers,
+               (nile_Process_t *p, float v_min_x, float v_min_y, float v_max_x, float v_max_y),
+               (p, v_min_x, v_min_y, v_max_x, v_max_y))
+GEZIRA_LEVELS (gezira_CalculateBounds, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_OffsetBezier,
+               (nile_Process_t *p, float v_o, float v_Z_A_x, float v_Z_A_y, float v_Z_B_x,
+                float v_Z_B_y, float v_Z_C_x, float v_Z_C_y),
+               (p, v_o, v_Z_A_x, v_Z_A_y, v_Z_B_x, v_Z_B_y, v_Z_C_x, v_Z_C_y))
+GEZIRA_LEVELS (gezira_MiterJoin,
+               (nile_Process_t *p, float v_o, float v_l, float v_P_x, float v_P_y, float v_u_x,
+                float v_u_y, float v_v_x, float v_v_y),
+               (p, v_o, v_l, v_P_x, v_P_y, v_u_x, v_u_y, v_v_x, v_v_y))
+GEZIRA_LEVELS (gezira_RoundJoin,
+               (nile_Process_t *p, float v_o, float v_P_x, float v_P_y, float v_u_x, float v_u_y,
+                float v_v_x, float v_v_y),
+               (p, v_o, v_P_x, v_P_y, v_u_x, v_u_y, v_v_x, v_v_y))
+GEZIRA_LEVELS (gezira_JoinBeziers,
+               (nile_Process_t *p, float v_o, float v_l, float v_Zi_A_x, float v_Zi_A_y,
+                float v_Zi_B_x, float v_Zi_B_y, float v_Zi_C_x, float v_Zi_C_y, float v_Zj_A_x,
+                float v_Zj_A_y, float v_Zj_B_x, float v_Zj_B_y, float v_Zj_C_x, float v_Zj_C_y),
+               (p, v_o, v_l, v_Zi_A_x, v_Zi_A_y, v_Zi_B_x, v_Zi_B_y, v_Zi_C_x, v_Zi_C_y, v_Zj_A_x,
+                v_Zj_A_y, v_Zj_B_x, v_Zj_B_y, v_Zj_C_x, v_Zj_C_y))
+GEZIRA_LEVELS (gezira_CapBezier,
+               (nile_Process_t *p, float v_o, float v_c, float v_Z_A_x, float v_Z_A_y,
+                float v_Z_B_x, float v_Z_B_y, float v_Z_C_x, float v_Z_C_y),
+               (p, v_o, v_c, v_Z_A_x, v_Z_A_y, v_Z_B_x, v_Z_B_y, v_Z_C_x, v_Z_C_y))
+GEZIRA_LEVELS (gezira_OffsetAndJoin,
+               (nile_Process_t *p, float v_o, float v_l, float v_c, float v_Z1_A_x, float v_Z1_A_y,
+                float v_Z1_B_x, float v_Z1_B_y, float v_Z1_C_x, float v_Z1_C_y, float v_Zi_A_x,
+                float v_Zi_A_y, float v_Zi_B_x, float v_Zi_B_y, float v_Zi_C_x, float v_Zi_C_y),
+               (p, v_o, v_l, v_c, v_Z1_A_x, v_Z1_A_y, v_Z1_B_x, v_Z1_B_y, v_Z1_C_x, v_Z1_C_y,
+                v_Zi_A_x, v_Zi_A_y, v_Zi_B_x, v_Zi_B_y, v_Zi_C_x, v_Zi_C_y))
+GEZIRA_LEVELS (gezira_StrokeOneSide,
+               (nile_Process_t *p, float v_w, float v_l, float v_c),
+               (p, v_w, v_l, v_c))
+GEZIRA_LEVELS (gezira_ReverseBeziers, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_SanitizeBezierPath, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_StrokeBezierPath,
+               (nile_Process_t *p, float v_w, float v_l, float v_c),
+               (p, v_w, v_l, v_c))
+GEZIRA_LEVELS (gezira_DecomposeBeziers, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CombineEdgeSamples, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_Rasterize, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_RectangleSpans,
+               (nile_Process_t *p, float v_min_x, float v_min_y, float v_max_x, float v_max_y),
+               (p, v_min_x, v_min_y, v_max_x, v_max_y))
+GEZIRA_LEVELS (gezira_TransformPoints,
+               (nile_Process_t *p, float v_M_a, float v_M_b, float v_M_c, float v_M_d, float v_M_e,
+                float v_M_f),
+               (p, v_M_a, v_M_b, v_M_c, v_M_d, v_M_e, v_M_f))
+GEZIRA_LEVELS (gezira_PadTexture, (nile_Process_t *p, float v_D_x, float v_D_y), (p, v_D_x, v_D_y))
+GEZIRA_LEVELS (gezira_RepeatTexture,
+               (nile_Process_t *p, float v_D_x, float v_D_y),
+               (p, v_D_x, v_D_y))
+GEZIRA_LEVELS (gezira_ReflectTexture,
+               (nile_Process_t *p, float v_D_x, float v_D_y),
+               (p, v_D_x, v_D_y))
+GEZIRA_LEVELS (gezira_UniformColor,
+               (nile_Process_t *p, float v_C_a, float v_C_r, float v_C_g, float v_C_b),
+               (p, v_C_a, v_C_r, v_C_g, v_C_b))
+GEZIRA_LEVELS (gezira_CompositeTextures,
+               (nile_Process_t *p, nile_Process_t *v_t1, nile_Process_t *v_t2, nile_Process_t *v_c),
+               (p, v_t1, v_t2, v_c))
+GEZIRA_LEVELS (gezira_ExpandSpans, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_ExtractSamplePoints, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_ApplyTexture, (nile_Process_t *p, nile_Process_t *v_t), (p, v_t))
+GEZIRA_LEVELS (gezira_SumWeightedColors, (nile_Process_t *p, float v_n), (p, v_n))
+GEZIRA_LEVELS (gezira_BilinearFilterPoints, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_BilinearFilterWeights, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_BilinearFilter, (nile_Process_t *p, nile_Process_t *v_t), (p, v_t))
+GEZIRA_LEVELS (gezira_BicubicFilterPoints, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_BicubicFilterDeltas, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_BicubicFilterWeights, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_BicubicFilter, (nile_Process_t *p, nile_Process_t *v_t), (p, v_t))
+GEZIRA_LEVELS (gezira_GaussianBlur5x1Points, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_GaussianBlur1x5Points, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_GaussianBlur5x1Weights, (nile_Process_t *p, float v_f), (p, v_f))
+GEZIRA_LEVELS (gezira_GaussianBlur5x1,
+               (nile_Process_t *p, float v_f, nile_Process_t *v_t),
+               (p, v_f, v_t))
+GEZIRA_LEVELS (gezira_GaussianBlur1x5,
+               (nile_Process_t *p, float v_f, nile_Process_t *v_t),
+               (p, v_f, v_t))
+GEZIRA_LEVELS (gezira_GaussianBlur11x1Points, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_GaussianBlur1x11Points, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_GaussianBlur11x1Weights, (nile_Process_t *p, float v_f), (p, v_f))
+GEZIRA_LEVELS (gezira_GaussianBlur11x1,
+               (nile_Process_t *p, float v_f, nile_Process_t *v_t),
+               (p, v_f, v_t))
+GEZIRA_LEVELS (gezira_GaussianBlur1x11,
+               (nile_Process_t *p, float v_f, nile_Process_t *v_t),
+               (p, v_f, v_t))
+GEZIRA_LEVELS (gezira_GaussianBlur21x1Points, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_GaussianBlur1x21Points, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_GaussianBlur21x1Weights, (nile_Process_t *p, float v_f), (p, v_f))
+GEZIRA_LEVELS (gezira_GaussianBlur21x1,
+               (nile_Process_t *p, float v_f, nile_Process_t *v_t),
+               (p, v_f, v_t))
+GEZIRA_LEVELS (gezira_GaussianBlur1x21,
+               (nile_Process_t *p, float v_f, nile_Process_t *v_t),
+               (p, v_f, v_t))
+GEZIRA_LEVELS (gezira_LinearGradient,
+               (nile_Process_t *p, float v_S_x, float v_S_y, float v_E_x, float v_E_y),
+               (p, v_S_x, v_S_y, v_E_x, v_E_y))
+GEZIRA_LEVELS (gezira_RadialGradient,
+               (nile_Process_t *p, float v_C_x, float v_C_y, float v_r),
+               (p, v_C_x, v_C_y, v_r))
+GEZIRA_LEVELS (gezira_PadGradient, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_RepeatGradient, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_ReflectGradient, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_ColorSpansBegin, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_ColorSpan,
+               (nile_Process_t *p, float v_S1_a, float v_S1_r, float v_S1_g, float v_S1_b,
+                float v_S2_a, float v_S2_r, float v_S2_g, float v_S2_b, float v_l),
+               (p, v_S1_a, v_S1_r, v_S1_g, v_S1_b, v_S2_a, v_S2_r, v_S2_g, v_S2_b, v_l))
+GEZIRA_LEVELS (gezira_ColorSpansEnd, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_ApplyColorSpans, (nile_Process_t *p, nile_Process_t *v_spans), (p, v_spans))
+GEZIRA_LEVELS (gezira_CompositeClear, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeSrc, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDst, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeOver, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDstOver, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeSrcIn, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDstIn, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeSrcOut, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDstOut, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeSrcAtop, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDstAtop, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeXor, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositePlus, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeMultiply, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeScreen, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeOverlay, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDarken, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeLighten, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeColorDodge, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeColorBurn, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeHardLight, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeSoftLight, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeDifference, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeExclusion, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeSubtract, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_CompositeInvert, (nile_Process_t *p), (p))
+GEZIRA_LEVELS (gezira_InverseOver, (nile_Process_t *p, float v_A), (p, v_A))
+GEZIRA_LEVELS (gezira_ContrastiveOver, (nile_Process_t *p, float v_a), (p, v_a))
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef GEZIRA_CPU_H
+#define GEZIRA_CPU_H
+
+/* Vector levels the hand-written kernels are built for when the library
+   is compiled with GEZIRA_DISPATCH. Without it every level runs the one
+   build. */
+#define GEZIRA_CPU_SSE2   0
+#define GEZIRA_CPU_AVX2   1
+#define GEZIRA_CPU_AVX512 2
+
+/* The level kernels made now will run at: the best the CPU has, lowered
+   by the GEZIRA_CPU environment variable ("sse2", "avx2" or "avx512") or
+   by gezira_cpu_force. */
+int
+gezira_cpu_level (void);
+
+/* Sets the level for kernels made from now on, never above the CPU's, or
+   with -1 goes back to the default. For testing. */
+void
+gezira_cpu_force (int level);
+
+/* A process body declared GEZIRA_KERNEL and followed by
+   GEZIRA_KERNEL_VARIANTS (name) is compiled once per level;
+   GEZIRA_KERNEL_FOR_CPU (name) picks the one for gezira_cpu_level. Other
+   functions can be built per level with GEZIRA_TARGET_AVX2 and
+   GEZIRA_TARGET_AVX512, which are defined only when they are. */
+#if defined (GEZIRA_DISPATCH) && defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+
+#define GEZIRA_TARGET_AVX2   __attribute__ ((target ("avx2,fma")))
+#define GEZIRA_TARGET_AVX512 __attribute__ ((target ("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")))
+
+#define GEZIRA_KERNEL static inline __attribute__ ((always_inline))
+
+#define GEZIRA_KERNEL_VARIANTS(name) GEZIRA_KERNEL_VARIANTS_ (name)
+#define GEZIRA_KERNEL_VARIANTS_(name) \
+    static nile_Buffer_t * \
+    name##_sse2 (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out) \
+    { return name (p, in, out); } \
+    static nile_Buffer_t * GEZIRA_TARGET_AVX2 \
+    name##_avx2 (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out) \
+    { return name (p, in, out); } \
+    static nile_Buffer_t * GEZIRA_TARGET_AVX512 \
+    name##_avx512 (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out) \
+    { return name (p, in, out); } \
+    static nile_Process_body_t \
+    name##_for_cpu (void) \
+    { \
+        int level = gezira_cpu_level (); \
+        return level >= GEZIRA_CPU_AVX512 ? name##_avx512 : \
+               level >= GEZIRA_CPU_AVX2   ? name##_avx2   : name##_sse2; \
+    }
+
+#else
+
+#define GEZIRA_KERNEL static
+
+#define GEZIRA_KERNEL_VARIANTS(name) GEZIRA_KERNEL_VARIANTS_ (name)
+#define GEZIRA_KERNEL_VARIANTS_(name) \
+    static nile_Process_body_t \
+    name##_for_cpu (void) \
+    { return name; }
+
+#endif
+
+#define GEZIRA_KERNEL_FOR_CPU(name) GEZIRA_KERNEL_FOR_CPU_ (name)
+#define GEZIRA_KERNEL_FOR_CPU_(name) name##_for_cpu ()
+
+#endif
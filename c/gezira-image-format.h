@@ -0,0 +1,368 @@
+/* Per-pixel-format image kernels. gezira-image.c includes this once per
+   format after defining:
+
+     GEZIRA_FORMAT                  name suffix, e.g. ARGB32
+     GEZIRA_PIXEL_T                 C type of one pixel
+     GEZIRA_UNPACK(C, a, r, g, b)   split pixel C into 8-bit channels
+     GEZIRA_PACK(a, r, g, b)        build a pixel from 8-bit channels
+
+   Channels are premultiplied. Formats without alpha unpack as opaque and
+   drop alpha when packing; A8 unpacks with zero color channels. */
+
+#define GEZIRA_FORMAT_NAME__(name, format, suffix) gezira_##name##_##format##suffix
+#define GEZIRA_FORMAT_NAME_(name, format, suffix)  GEZIRA_FORMAT_NAME__(name, format, suffix)
+#define GEZIRA_FORMAT_NAME(name, suffix)           GEZIRA_FORMAT_NAME_(name, GEZIRA_FORMAT, suffix)
+
+/* Points are handled GEZIRA_FORMAT_CHUNK at a time, with the bounds,
+   unpacking and blending in loops of their own around the pixel loads so
+   the compiler can vectorize them. */
+#ifndef GEZIRA_FORMAT_CHUNK
+#define GEZIRA_FORMAT_CHUNK 64
+#endif
+
+GEZIRA_KERNEL nile_Buffer_t *
+GEZIRA_FORMAT_NAME (ReadFromImage, _body) (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_Image_t image = *(gezira_Image_t *) nile_Process_vars (p);
+    GEZIRA_PIXEL_T *pixels = image.pixels;
+    Real      width  = nile_Real (image.width);
+    Real      height = nile_Real (image.height);
+    int       stride = image.stride;
+    Real      X[GEZIRA_FORMAT_CHUNK], Y[GEZIRA_FORMAT_CHUNK];
+    int       I[GEZIRA_FORMAT_CHUNK];
+    GEZIRA_PIXEL_T C[GEZIRA_FORMAT_CHUNK];
+    Real      A[GEZIRA_FORMAT_CHUNK], R[GEZIRA_FORMAT_CHUNK];
+    Real      G[GEZIRA_FORMAT_CHUNK], B[GEZIRA_FORMAT_CHUNK];
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        int i;
+        m = m < o ? m : o;
+        m = m < GEZIRA_FORMAT_CHUNK ? m : GEZIRA_FORMAT_CHUNK;
+        for (i = 0; i < m; i++) {
+            X[i] = nile_Buffer_pop_head (in);
+            Y[i] = nile_Buffer_pop_head (in);
+        }
+        for (i = 0; i < m; i++) {
+            Real x = X[i];
+            Real y = Y[i];
+            x = nile_Real_nz (nile_Real_eq (x, width )) ? nile_Real_sub (width,  nile_Real (1)) : x;
+            y = nile_Real_nz (nile_Real_eq (y, height)) ? nile_Real_sub (height, nile_Real (1)) : y;
+            int OOB = nile_Real_nz (nile_Real_lt (x, nile_Real (0))) |
+                      nile_Real_nz (nile_Real_lt (y, nile_Real (0))) |
+                      nile_Real_nz (nile_Real_gt (x, width))         |
+                      nile_Real_nz (nile_Real_gt (y, height));
+            x = OOB ? nile_Real (0) : x;
+            y = OOB ? nile_Real (0) : y;
+            I[i] = OOB ? -1 : nile_Real_toi (x) + nile_Real_toi (y) * stride;
+        }
+        for (i = 0; i < m; i++)
+            C[i] = pixels[I[i] < 0 ? 0 : I[i]];
+        for (i = 0; i < m; i++) {
+            uint8_t a, r, g, b;
+            GEZIRA_UNPACK (C[i], a, r, g, b);
+            if (I[i] < 0)
+                a = r = g = b = 0;
+            A[i] = nile_Real_div (nile_Real (a), nile_Real (255));
+            R[i] = nile_Real_div (nile_Real (r), nile_Real (255));
+            G[i] = nile_Real_div (nile_Real (g), nile_Real (255));
+            B[i] = nile_Real_div (nile_Real (b), nile_Real (255));
+        }
+        for (i = 0; i < m; i++) {
+            nile_Buffer_push_tail (out, A[i]); nile_Buffer_push_tail (out, R[i]);
+            nile_Buffer_push_tail (out, G[i]); nile_Buffer_push_tail (out, B[i]);
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (GEZIRA_FORMAT_NAME (ReadFromImage, _body))
+
+nile_Process_t *
+GEZIRA_FORMAT_NAME (ReadFromImage, ) (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
+{
+    nile_Process_t *parent = p;
+    p = nile_Process (p, 2, sizeof (*image), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (GEZIRA_FORMAT_NAME (ReadFromImage, _body)), NULL);
+    if (p) {
+        gezira_Image_t *vars = nile_Process_vars (p);
+        *vars = *image;
+        p = gezira_Image_sequence (parent, p, image, skipNextGate);
+    }
+    return p;
+}
+
+static inline GEZIRA_PIXEL_T
+GEZIRA_FORMAT_NAME (WriteToImage, _blend) (GEZIRA_PIXEL_T D, uint8_t sa, uint8_t sr, uint8_t sg,
+                                           uint8_t sb, uint8_t c, uint8_t ic)
+{
+    uint8_t da, dr, dg, db;
+    GEZIRA_UNPACK (D, da, dr, dg, db);
+    uint16_t a = sa * c + da * ic;
+    uint16_t r = sr * c + dr * ic;
+    uint16_t g = sg * c + dg * ic;
+    uint16_t b = sb * c + db * ic;
+
+    a >>= 8;
+    r >>= 8;
+    g >>= 8;
+    b >>= 8;
+
+    /*
+    a += 128;
+    r += 128;
+    g += 128;
+    b += 128;
+    a = (a + (a >> 8)) >> 8;
+    r = (r + (r >> 8)) >> 8;
+    g = (g + (g >> 8)) >> 8;
+    b = (b + (b >> 8)) >> 8;
+    */
+
+    return GEZIRA_PACK (a, r, g, b);
+}
+
+/* Pixels are stored all at once after the chunk is blended, which is only
+   right if no pixel comes twice; chunks whose points are not in increasing
+   order are blended one point at a time instead. Points with ic = 0 are
+   stored without reading or blending the destination; the chunk is split
+   into runs of such points and runs to blend. */
+GEZIRA_KERNEL nile_Buffer_t *
+GEZIRA_FORMAT_NAME (WriteToImage, _body) (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_Image_t image = *(gezira_Image_t *) nile_Process_vars (p);
+    GEZIRA_PIXEL_T *pixels = image.pixels;
+    int       width  = image.width;
+    int       height = image.height;
+    int       stride = image.stride;
+    Real      SA[GEZIRA_FORMAT_CHUNK], SR[GEZIRA_FORMAT_CHUNK];
+    Real      SG[GEZIRA_FORMAT_CHUNK], SB[GEZIRA_FORMAT_CHUNK];
+    Real      X[GEZIRA_FORMAT_CHUNK], Y[GEZIRA_FORMAT_CHUNK];
+    Real      CV[GEZIRA_FORMAT_CHUNK], ICV[GEZIRA_FORMAT_CHUNK];
+    uint8_t   sa[GEZIRA_FORMAT_CHUNK], sr[GEZIRA_FORMAT_CHUNK];
+    uint8_t   sg[GEZIRA_FORMAT_CHUNK], sb[GEZIRA_FORMAT_CHUNK];
+    uint8_t   c[GEZIRA_FORMAT_CHUNK], ic[GEZIRA_FORMAT_CHUNK];
+    int       I[GEZIRA_FORMAT_CHUNK];
+    GEZIRA_PIXEL_T D[GEZIRA_FORMAT_CHUNK];
+
+    int n = (in->tail - in->head) / 8;
+    while (n > 0) {
+        int m = n < GEZIRA_FORMAT_CHUNK ? n : GEZIRA_FORMAT_CHUNK;
+        int i, j, k, last = -1, ordered = 1;
+        n -= m;
+        for (i = 0; i < m; i++) {
+            SA[i] = nile_Buffer_pop_head (in);
+            SR[i] = nile_Buffer_pop_head (in);
+            SG[i] = nile_Buffer_pop_head (in);
+            SB[i] = nile_Buffer_pop_head (in);
+            X[i]  = nile_Buffer_pop_head (in);
+            Y[i]  = nile_Buffer_pop_head (in);
+            CV[i] = nile_Buffer_pop_head (in);
+            ICV[i] = nile_Buffer_pop_head (in);
+        }
+        for (i = 0; i < m; i++) {
+            int x = nile_Real_toi (X[i]);
+            int y = nile_Real_toi (Y[i]);
+            sa[i] = Real_to_uint8_t (SA[i]);
+            sr[i] = Real_to_uint8_t (SR[i]);
+            sg[i] = Real_to_uint8_t (SG[i]);
+            sb[i] = Real_to_uint8_t (SB[i]);
+            c[i]  = Real_to_uint8_t (CV[i]);
+            ic[i] = Real_to_uint8_t (ICV[i]);
+            I[i]  = ((c[i] == 0) |
+                     (x <  0) | (width  <= x) |
+                     (y <  0) | (height <= y)) ? -1 : x + y * stride;
+        }
+        for (i = 0; i < m; i++) {
+            if (I[i] < 0)
+                continue;
+            ordered &= I[i] > last;
+            last = I[i];
+        }
+        if (!ordered) {
+            for (i = 0; i < m; i++)
+                if (I[i] >= 0)
+                    pixels[I[i]] = ic[i] == 0 ? GEZIRA_PACK (sa[i], sr[i], sg[i], sb[i]) :
+                                   GEZIRA_FORMAT_NAME (WriteToImage, _blend) (pixels[I[i]],
+                                       sa[i], sr[i], sg[i], sb[i], c[i], ic[i]);
+            continue;
+        }
+        for (i = 0; i < m; i = j) {
+            int opaque = ic[i] == 0;
+            for (j = i + 1; j < m && (ic[j] == 0) == opaque; j++)
+                ;
+            if (opaque) {
+                for (k = i; k < j; k++)
+                    if (I[k] >= 0)
+                        pixels[I[k]] = GEZIRA_PACK (sa[k], sr[k], sg[k], sb[k]);
+                continue;
+            }
+            for (k = i; k < j; k++)
+                D[k] = I[k] < 0 ? 0 : pixels[I[k]];
+            for (k = i; k < j; k++)
+                D[k] = GEZIRA_FORMAT_NAME (WriteToImage, _blend) (D[k], sa[k], sr[k], sg[k],
+                                                                   sb[k], c[k], ic[k]);
+            for (k = i; k < j; k++)
+                if (I[k] >= 0)
+                    pixels[I[k]] = D[k];
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (GEZIRA_FORMAT_NAME (WriteToImage, _body))
+
+nile_Process_t *
+GEZIRA_FORMAT_NAME (WriteToImage, ) (nile_Process_t *p, gezira_Image_t *image)
+{
+    nile_Process_t *parent = p;
+    p = nile_Process (p, 8, sizeof (*image), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (GEZIRA_FORMAT_NAME (WriteToImage, _body)), NULL);
+    if (p) {
+        gezira_Image_t *vars = nile_Process_vars (p);
+        *vars = *image;
+        p = gezira_Image_sequence (parent, p, image, 0);
+        image->version++;
+    }
+    return p;
+}
+
+typedef struct {
+    uint8_t         a8,  r8,  g8,  b8;
+    uint16_t       a16, r16, g16, b16;
+    GEZIRA_PIXEL_T             packed;
+    uint8_t                       ia8;
+    gezira_Image_t              image;
+} GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _vars_t);
+
+GEZIRA_KERNEL nile_Buffer_t *
+GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _body) (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _vars_t) v =
+        *(GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _vars_t) *) nile_Process_vars (p);
+    GEZIRA_PIXEL_T *pixels = v.image.pixels;
+    int       width  = v.image.width;
+    int       height = v.image.height;
+    int       stride = v.image.stride;
+
+    while (!nile_Buffer_is_empty (in)) {
+        int     x = nile_Real_toi (nile_Buffer_pop_head (in));
+        int     y = nile_Real_toi (nile_Buffer_pop_head (in));
+        uint8_t c = Real_to_uint8_t (nile_Buffer_pop_head (in));
+        int     l = nile_Real_toi (nile_Buffer_pop_head (in));
+        GEZIRA_PIXEL_T *px = &pixels[x + y * stride];
+
+        if (c == 0 || l <= 0          ||
+            x <  0 || width  <  x + l ||
+            y <  0 || height <= y)
+            continue;
+
+        if (c == 255) {
+            if (v.ia8 == 0) {
+                while (l--)
+                    *px++ = v.packed;
+            }
+            else {
+                while (l--) {
+                    uint8_t  da, dr, dg, db;
+                    GEZIRA_UNPACK (*px, da, dr, dg, db);
+                    uint16_t a  = v.a16 + da * v.ia8;
+                    uint16_t r  = v.r16 + dr * v.ia8;
+                    uint16_t g  = v.g16 + dg * v.ia8;
+                    uint16_t b  = v.b16 + db * v.ia8;
+
+                    a >>= 8;
+                    r >>= 8;
+                    g >>= 8;
+                    b >>= 8;
+
+                    /*
+                    a = (a + (a >> 8)) >> 8;
+                    r = (r + (r >> 8)) >> 8;
+                    g = (g + (g >> 8)) >> 8;
+                    b = (b + (b >> 8)) >> 8;
+                    */
+
+                    *px++ = GEZIRA_PACK (a, r, g, b);
+                }
+            }
+        }
+        else {
+            while (l--) {
+                uint8_t  da, dr, dg, db;
+                GEZIRA_UNPACK (*px, da, dr, dg, db);
+                uint16_t a  = v.a8 * c;
+                uint16_t r  = v.r8 * c;
+                uint16_t g  = v.g8 * c;
+                uint16_t b  = v.b8 * c;
+
+                uint16_t ia = (255 * 255 - a) >> 8;
+                a = (a + da * ia) >> 8;
+                r = (r + dr * ia) >> 8;
+                g = (g + dg * ia) >> 8;
+                b = (b + db * ia) >> 8;
+
+                /*
+                uint16_t ia = (255 * 255 - a) + 128;
+                ia = (ia + (ia >> 8)) >> 8;
+                a = a + da * ia + 128;
+                r = r + dr * ia + 128;
+                g = g + dg * ia + 128;
+                b = b + db * ia + 128;
+                a = (a + (a >> 8)) >> 8;
+                r = (r + (r >> 8)) >> 8;
+                g = (g + (g >> 8)) >> 8;
+                b = (b + (b >> 8)) >> 8;
+                */
+
+                *px++ = GEZIRA_PACK (a, r, g, b);
+            }
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _body))
+
+nile_Process_t *
+GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, ) (nile_Process_t *p, gezira_Image_t *image,
+                                                       float a, float r, float g, float b)
+{
+    GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _vars_t) *vars;
+    nile_Process_t *parent = p;
+    p = nile_Process (p, 4, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (GEZIRA_FORMAT_NAME (CompositeUniformColorOverImage, _body)), NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->a8 =     a * 255.0f + 0.5f;
+        vars->r8 = a * r * 255.0f + 0.5f;
+        vars->g8 = a * g * 255.0f + 0.5f;
+        vars->b8 = a * b * 255.0f + 0.5f;
+        vars->a16 =     a * 255.0f * 255.0f + 0.5f;
+        vars->r16 = a * r * 255.0f * 255.0f + 0.5f;
+        vars->g16 = a * g * 255.0f * 255.0f + 0.5f;
+        vars->b16 = a * b * 255.0f * 255.0f + 0.5f;
+        vars->a16 += 128;
+        vars->r16 += 128;
+        vars->g16 += 128;
+        vars->b16 += 128;
+        vars->packed = GEZIRA_PACK (vars->a8, vars->r8, vars->g8, vars->b8);
+        vars->ia8 = 255 - vars->a8;
+        vars->image = *image;
+
+        p = gezira_Image_sequence (parent, p, image, 0);
+        image->version++;
+    }
+    return p;
+}
+
+#undef GEZIRA_FORMAT_NAME
+#undef GEZIRA_FORMAT_NAME_
+#undef GEZIRA_FORMAT_NAME__
+#undef GEZIRA_FORMAT
+#undef GEZIRA_PIXEL_T
+#undef GEZIRA_UNPACK
+#undef GEZIRA_PACK
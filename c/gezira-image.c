@@ -1,7 +1,9 @@
 #include <stddef.h>
 #include <stdint.h>
+#include <math.h>
 #define NILE_INCLUDE_PROCESS_API
 #include "nile.h"
+#include "gezira-cpu.h"
 #include "gezira-image.h"
 
 #define Real nile_Real_t
@@ -20,6 +22,7 @@ gezira_Image_init (gezira_Image_t *image, void *pixels, int width, int height, i
     image->height = height;
     image->stride = stride;
     image->gate = NULL;
+    image->version = 0;
 }
 
 void
@@ -37,42 +40,158 @@ gezira_Image_reset_gate (gezira_Image_t *image)
     image->gate = NULL;
 }
 
-static nile_Buffer_t *
-gezira_ReadFromImage_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+nile_Process_t *
+gezira_Image_sequence (nile_Process_t *parent, nile_Process_t *p,
+                       gezira_Image_t *image, int skipNextGate)
+{
+    nile_Process_t *nextGate = skipNextGate ? NULL : nile_Identity (parent, 1);
+    nile_Process_gate (p, nextGate);
+    if (image->gate)
+        p = nile_Process_pipe (image->gate, p, NILE_NULL);
+    image->gate = nextGate;
+    return p;
+}
+
+#define GEZIRA_FORMAT  ARGB32
+#define GEZIRA_PIXEL_T uint32_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (a = (C) >> 24, r = (C) >> 16, g = (C) >> 8, b = (C) >> 0)
+#define GEZIRA_PACK(a, r, g, b) \
+    (((uint32_t) (a) << 24) | ((uint32_t) (r) << 16) | ((uint32_t) (g) << 8) | (uint32_t) (b))
+#include "gezira-image-format.h"
+
+#define GEZIRA_FORMAT  ABGR32
+#define GEZIRA_PIXEL_T uint32_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (a = (C) >> 24, b = (C) >> 16, g = (C) >> 8, r = (C) >> 0)
+#define GEZIRA_PACK(a, r, g, b) \
+    (((uint32_t) (a) << 24) | ((uint32_t) (b) << 16) | ((uint32_t) (g) << 8) | (uint32_t) (r))
+#include "gezira-image-format.h"
+
+#define GEZIRA_FORMAT  RGBA32
+#define GEZIRA_PIXEL_T uint32_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (r = (C) >> 24, g = (C) >> 16, b = (C) >> 8, a = (C) >> 0)
+#define GEZIRA_PACK(a, r, g, b) \
+    (((uint32_t) (r) << 24) | ((uint32_t) (g) << 16) | ((uint32_t) (b) << 8) | (uint32_t) (a))
+#include "gezira-image-format.h"
+
+#define GEZIRA_FORMAT  BGRA32
+#define GEZIRA_PIXEL_T uint32_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (b = (C) >> 24, g = (C) >> 16, r = (C) >> 8, a = (C) >> 0)
+#define GEZIRA_PACK(a, r, g, b) \
+    (((uint32_t) (b) << 24) | ((uint32_t) (g) << 16) | ((uint32_t) (r) << 8) | (uint32_t) (a))
+#include "gezira-image-format.h"
+
+#define GEZIRA_FORMAT  XRGB32
+#define GEZIRA_PIXEL_T uint32_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (a = 255, r = (C) >> 16, g = (C) >> 8, b = (C) >> 0)
+#define GEZIRA_PACK(a, r, g, b) \
+    (0xff000000u | ((uint32_t) (r) << 16) | ((uint32_t) (g) << 8) | (uint32_t) (b))
+#include "gezira-image-format.h"
+
+#define GEZIRA_FORMAT  A8
+#define GEZIRA_PIXEL_T uint8_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (a = (C), r = g = b = 0)
+#define GEZIRA_PACK(a, r, g, b) \
+    ((uint8_t) (a))
+#include "gezira-image-format.h"
+
+#define GEZIRA_FORMAT  RGB16_565
+#define GEZIRA_PIXEL_T uint16_t
+#define GEZIRA_UNPACK(C, a, r, g, b) \
+    (a = 255, \
+     r = (((C) >> 11) << 3) | ((C) >> 13), \
+     g = ((((C) >> 5) & 0x3f) << 2) | (((C) >> 9) & 0x03), \
+     b = (((C) & 0x1f) << 3) | (((C) >> 2) & 0x07))
+#define GEZIRA_PACK(a, r, g, b) \
+    ((uint16_t) ((((r) >> 3) << 11) | (((g) >> 2) << 5) | ((b) >> 3)))
+#include "gezira-image-format.h"
+
+/* Catmull-Rom weights for the four taps around a sample, tabulated by the
+   sample's fractional offset from the tap at or left of it. */
+#define GEZIRA_BICUBIC_STEPS 256
+#define GEZIRA_BICUBIC_NEAR(t) ( 1.5f * (t) * (t) * (t) - 2.5f * (t) * (t) + 1)
+#define GEZIRA_BICUBIC_FAR(t)  (-0.5f * (t) * (t) * (t) + 2.5f * (t) * (t) - 4 * (t) + 2)
+#define GEZIRA_BICUBIC_U(i)    ((float) (i) / GEZIRA_BICUBIC_STEPS)
+#define GEZIRA_BICUBIC_ROW(i) \
+    {GEZIRA_BICUBIC_FAR  (GEZIRA_BICUBIC_U (i) + 1), \
+     GEZIRA_BICUBIC_NEAR (GEZIRA_BICUBIC_U (i)), \
+     GEZIRA_BICUBIC_NEAR (1 - GEZIRA_BICUBIC_U (i)), \
+     GEZIRA_BICUBIC_FAR  (2 - GEZIRA_BICUBIC_U (i))}
+#define GEZIRA_BICUBIC_ROW4(i) \
+    GEZIRA_BICUBIC_ROW (i),     GEZIRA_BICUBIC_ROW ((i) + 1), \
+    GEZIRA_BICUBIC_ROW ((i) + 2), GEZIRA_BICUBIC_ROW ((i) + 3)
+#define GEZIRA_BICUBIC_ROW16(i) \
+    GEZIRA_BICUBIC_ROW4 (i),     GEZIRA_BICUBIC_ROW4 ((i) + 4), \
+    GEZIRA_BICUBIC_ROW4 ((i) + 8), GEZIRA_BICUBIC_ROW4 ((i) + 12)
+#define GEZIRA_BICUBIC_ROW64(i) \
+    GEZIRA_BICUBIC_ROW16 (i),      GEZIRA_BICUBIC_ROW16 ((i) + 16), \
+    GEZIRA_BICUBIC_ROW16 ((i) + 32), GEZIRA_BICUBIC_ROW16 ((i) + 48)
+
+/* Built at compile time so samplers on any thread can read it. */
+static const float gezira_bicubic_weights[GEZIRA_BICUBIC_STEPS + 1][4] = {
+    GEZIRA_BICUBIC_ROW64 (0),   GEZIRA_BICUBIC_ROW64 (64),
+    GEZIRA_BICUBIC_ROW64 (128), GEZIRA_BICUBIC_ROW64 (192),
+    GEZIRA_BICUBIC_ROW (GEZIRA_BICUBIC_STEPS)
+};
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ReadFromImage_Bicubic_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
 {
     gezira_Image_t image = *(gezira_Image_t *) nile_Process_vars (p);
     uint32_t *pixels = image.pixels;
-    Real      width  = nile_Real (image.width);
-    Real      height = nile_Real (image.height);
+    int       width  = image.width;
+    int       height = image.height;
     int       stride = image.stride;
+    float     s      = 1 / 255.0f;
 
     while (!nile_Buffer_is_empty (in)) {
         int m = (in->tail - in->head) / 2;
         int o = (out->capacity - out->tail) / 4;
         m = m < o ? m : o;
         while (m--) {
-            Real x = nile_Buffer_pop_head (in);
-            Real y = nile_Buffer_pop_head (in);
-            x = nile_Real_nz (nile_Real_eq (x, width )) ? nile_Real_sub (width,  nile_Real (1)) : x;
-            y = nile_Real_nz (nile_Real_eq (y, height)) ? nile_Real_sub (height, nile_Real (1)) : y;
-            int OOB = nile_Real_nz (nile_Real_lt (x, nile_Real (0))) ||
-                      nile_Real_nz (nile_Real_lt (y, nile_Real (0))) ||
-                      nile_Real_nz (nile_Real_gt (x, width))         ||
-                      nile_Real_nz (nile_Real_gt (y, height));
-            x = OOB ? nile_Real (0) : x;
-            y = OOB ? nile_Real (0) : y;
-            uint32_t C = pixels[nile_Real_toi (x) + nile_Real_toi (y) * stride];
-            C = OOB ? 0 : C;
-            uint8_t a = C >> 24;
-            uint8_t r = C >> 16;
-            uint8_t g = C >>  8;
-            uint8_t b = C >>  0;
-            Real a_ = nile_Real_div (nile_Real (a), nile_Real (255));
-            Real r_ = nile_Real_div (nile_Real (r), nile_Real (255));
-            Real g_ = nile_Real_div (nile_Real (g), nile_Real (255));
-            Real b_ = nile_Real_div (nile_Real (b), nile_Real (255));
-            nile_Buffer_push_tail (out, a_); nile_Buffer_push_tail (out, r_);
-            nile_Buffer_push_tail (out, g_); nile_Buffer_push_tail (out, b_);
+            float x = nile_Real_tof (nile_Buffer_pop_head (in)) - 0.5f;
+            float y = nile_Real_tof (nile_Buffer_pop_head (in)) - 0.5f;
+            float C[4] = {0, 0, 0, 0};
+            if (x >= -0.5f && y >= -0.5f && x <= width - 0.5f && y <= height - 0.5f) {
+                int x0 = x < 0 ? -1 : (int) x;
+                int y0 = y < 0 ? -1 : (int) y;
+                const float *wx = gezira_bicubic_weights[(int) ((x - x0) * GEZIRA_BICUBIC_STEPS)];
+                const float *wy = gezira_bicubic_weights[(int) ((y - y0) * GEZIRA_BICUBIC_STEPS)];
+                int xs[4];
+                int i, j;
+                for (i = 0; i < 4; i++) {
+                    int xi = x0 - 1 + i;
+                    xs[i] = xi < 0 ? 0 : xi >= width ? width - 1 : xi;
+                }
+                for (j = 0; j < 4; j++) {
+                    int yj = y0 - 1 + j;
+                    uint32_t *row = pixels + (yj < 0 ? 0 : yj >= height ? height - 1 : yj) * stride;
+                    uint32_t p0 = row[xs[0]], p1 = row[xs[1]], p2 = row[xs[2]], p3 = row[xs[3]];
+                    float a = wx[0] * (p0 >> 24)          + wx[1] * (p1 >> 24)          +
+                              wx[2] * (p2 >> 24)          + wx[3] * (p3 >> 24);
+                    float r = wx[0] * ((p0 >> 16) & 0xff) + wx[1] * ((p1 >> 16) & 0xff) +
+                              wx[2] * ((p2 >> 16) & 0xff) + wx[3] * ((p3 >> 16) & 0xff);
+                    float g = wx[0] * ((p0 >>  8) & 0xff) + wx[1] * ((p1 >>  8) & 0xff) +
+                              wx[2] * ((p2 >>  8) & 0xff) + wx[3] * ((p3 >>  8) & 0xff);
+                    float b = wx[0] * ((p0 >>  0) & 0xff) + wx[1] * ((p1 >>  0) & 0xff) +
+                              wx[2] * ((p2 >>  0) & 0xff) + wx[3] * ((p3 >>  0) & 0xff);
+                    C[0] += wy[j] * a;
+                    C[1] += wy[j] * r;
+                    C[2] += wy[j] * g;
+                    C[3] += wy[j] * b;
+                }
+                for (i = 0; i < 4; i++) {
+                    C[i] *= s;
+                    C[i] = C[i] < 0 ? 0 : C[i] > 1 ? 1 : C[i];
+                }
+            }
+            nile_Buffer_push_tail (out, nile_Real (C[0])); nile_Buffer_push_tail (out, nile_Real (C[1]));
+            nile_Buffer_push_tail (out, nile_Real (C[2])); nile_Buffer_push_tail (out, nile_Real (C[3]));
         }
         if (nile_Buffer_tailroom (out) < 4)
             out = nile_Process_append_output (p, out);
@@ -80,230 +199,320 @@ gezira_ReadFromImage_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buf
     return out;
 }
 
+GEZIRA_KERNEL_VARIANTS (gezira_ReadFromImage_Bicubic_ARGB32_body)
+
 nile_Process_t *
-gezira_ReadFromImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
+gezira_ReadFromImage_Bicubic_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
 {
     nile_Process_t *parent = p;
-    p = nile_Process (p, 2, sizeof (*image), NULL, gezira_ReadFromImage_ARGB32_body, NULL);
+    p = nile_Process (p, 2, sizeof (*image), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ReadFromImage_Bicubic_ARGB32_body), NULL);
     if (p) {
         gezira_Image_t *vars = nile_Process_vars (p);
-        nile_Process_t *nextGate = skipNextGate ? NULL : nile_Identity (parent, 1);
         *vars = *image;
-        nile_Process_gate (p, nextGate);
-        if (image->gate)
-            p = nile_Process_pipe (image->gate, p, NILE_NULL);
-        image->gate = nextGate;
+        p = gezira_Image_sequence (parent, p, image, skipNextGate);
     }
     return p;
 }
 
-static nile_Buffer_t *
-gezira_WriteToImage_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ReadFromImage_Bilinear_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
 {
     gezira_Image_t image = *(gezira_Image_t *) nile_Process_vars (p);
     uint32_t *pixels = image.pixels;
     int       width  = image.width;
     int       height = image.height;
     int       stride = image.stride;
+    float     s      = 1 / 255.0f;
 
-    int m = (in->tail - in->head) / 8;
-    while (m--) {
-        uint8_t sa = Real_to_uint8_t (nile_Buffer_pop_head (in));
-        uint8_t sr = Real_to_uint8_t (nile_Buffer_pop_head (in)); 
-        uint8_t sg = Real_to_uint8_t (nile_Buffer_pop_head (in)); 
-        uint8_t sb = Real_to_uint8_t (nile_Buffer_pop_head (in)); 
-        int x = nile_Real_toi (nile_Buffer_pop_head (in));
-        int y = nile_Real_toi (nile_Buffer_pop_head (in));
-        uint8_t c  = Real_to_uint8_t (nile_Buffer_pop_head (in));
-        uint8_t ic = Real_to_uint8_t (nile_Buffer_pop_head (in));
-        uint32_t *px = &pixels[x + y * stride];
-
-        if (c == 0 ||
-            x <  0 || width  <= x ||
-            y <  0 || height <= y)
-            continue;
-
-        uint32_t d = *px;
-        uint8_t da = d >> 24;
-        uint8_t dr = d >> 16;
-        uint8_t dg = d >>  8;
-        uint8_t db = d >>  0;
-        uint16_t a = sa * c + da * ic;
-        uint16_t r = sr * c + dr * ic;
-        uint16_t g = sg * c + dg * ic;
-        uint16_t b = sb * c + db * ic;
-
-        a >>= 8;
-        r >>= 8;
-        g >>= 8;
-        b >>= 8;
-        
-        /*
-        a += 128;
-        r += 128;
-        g += 128;
-        b += 128;
-        a = (a + (a >> 8)) >> 8;
-        r = (r + (r >> 8)) >> 8;
-        g = (g + (g >> 8)) >> 8;
-        b = (b + (b >> 8)) >> 8;
-        */
-
-        *px = (a << 24) | (r << 16) | (g << 8) | (b << 0);
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in)) - 0.5f;
+            float y = nile_Real_tof (nile_Buffer_pop_head (in)) - 0.5f;
+            float C[4] = {0, 0, 0, 0};
+            if (x >= -0.5f && y >= -0.5f && x <= width - 0.5f && y <= height - 0.5f) {
+                int x0 = x < 0 ? -1 : (int) x;
+                int y0 = y < 0 ? -1 : (int) y;
+                float u = x - x0;
+                float v = y - y0;
+                int x1 = x0 + 1 < width  ? x0 + 1 : width  - 1;
+                int y1 = y0 + 1 < height ? y0 + 1 : height - 1;
+                uint32_t *row0 = pixels + (y0 < 0 ? 0 : y0) * stride;
+                uint32_t *row1 = pixels + y1 * stride;
+                x0 = x0 < 0 ? 0 : x0;
+                uint32_t p00 = row0[x0], p01 = row0[x1];
+                uint32_t p10 = row1[x0], p11 = row1[x1];
+                float w00 = (1 - u) * (1 - v) * s, w01 = u * (1 - v) * s;
+                float w10 = (1 - u) * v * s,       w11 = u * v * s;
+                int i;
+                for (i = 0; i < 4; i++) {
+                    int shift = 24 - 8 * i;
+                    C[i] = w00 * ((p00 >> shift) & 0xff) + w01 * ((p01 >> shift) & 0xff) +
+                           w10 * ((p10 >> shift) & 0xff) + w11 * ((p11 >> shift) & 0xff);
+                }
+            }
+            nile_Buffer_push_tail (out, nile_Real (C[0])); nile_Buffer_push_tail (out, nile_Real (C[1]));
+            nile_Buffer_push_tail (out, nile_Real (C[2])); nile_Buffer_push_tail (out, nile_Real (C[3]));
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
     }
     return out;
 }
 
+GEZIRA_KERNEL_VARIANTS (gezira_ReadFromImage_Bilinear_ARGB32_body)
+
 nile_Process_t *
-gezira_WriteToImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image)
+gezira_ReadFromImage_Bilinear_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
 {
     nile_Process_t *parent = p;
-    p = nile_Process (p, 8, sizeof (*image), NULL, gezira_WriteToImage_ARGB32_body, NULL);
+    p = nile_Process (p, 2, sizeof (*image), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ReadFromImage_Bilinear_ARGB32_body), NULL);
     if (p) {
         gezira_Image_t *vars = nile_Process_vars (p);
-        nile_Process_t *nextGate = nile_Identity (parent, 1);
         *vars = *image;
-        nile_Process_gate (p, nextGate);
-        if (image->gate)
-            p = nile_Process_pipe (image->gate, p, NILE_NULL);
-        image->gate = nextGate;
+        p = gezira_Image_sequence (parent, p, image, skipNextGate);
     }
     return p;
 }
 
+/* Nearest-texel reads with the image's own size as the pattern size, so the
+   Pad/Repeat/ReflectTexture wrap is done on integer texel indices. Power of
+   two sizes wrap with a mask. */
+#define GEZIRA_WRAP_PAD     0
+#define GEZIRA_WRAP_REPEAT  1
+#define GEZIRA_WRAP_REFLECT 2
+
 typedef struct {
-    uint8_t         a8,  r8,  g8,  b8;
-    uint16_t       a16, r16, g16, b16;
-    uint32_t                 a8r8g8b8; 
-    uint8_t                       ia8;
-    gezira_Image_t              image;
-} gezira_CompositeUniformColorOverImage_ARGB32_vars_t;
-
-static nile_Buffer_t *
-gezira_CompositeUniformColorOverImage_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+    gezira_Image_t  image;
+    int             mode;
+    int             xmask, ymask;
+} gezira_ReadFromImage_Wrap_ARGB32_vars_t;
+
+static inline int
+gezira_wrap_index (int i, int n, int mask, int mode)
 {
-    gezira_CompositeUniformColorOverImage_ARGB32_vars_t v =
-        *(gezira_CompositeUniformColorOverImage_ARGB32_vars_t *) nile_Process_vars (p);
+    int period = mode == GEZIRA_WRAP_REFLECT ? 2 * n : n;
+    if (mode == GEZIRA_WRAP_PAD)
+        return i < 0 ? 0 : i >= n ? n - 1 : i;
+    if (mask >= 0)
+        i &= mask;
+    else {
+        i %= period;
+        i = i < 0 ? i + period : i;
+    }
+    return i < n ? i : period - 1 - i;
+}
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ReadFromImage_Wrap_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_ReadFromImage_Wrap_ARGB32_vars_t v =
+        *(gezira_ReadFromImage_Wrap_ARGB32_vars_t *) nile_Process_vars (p);
     uint32_t *pixels = v.image.pixels;
     int       width  = v.image.width;
     int       height = v.image.height;
     int       stride = v.image.stride;
 
     while (!nile_Buffer_is_empty (in)) {
-        int     x = nile_Real_toi (nile_Buffer_pop_head (in));
-        int     y = nile_Real_toi (nile_Buffer_pop_head (in));
-        uint8_t c = Real_to_uint8_t (nile_Buffer_pop_head (in));
-        int     l = nile_Real_toi (nile_Buffer_pop_head (in));
-        uint32_t *px = &pixels[x + y * stride];
-
-        if (c == 0 || l <= 0          ||
-            x <  0 || width  <  x + l ||
-            y <  0 || height <= y)
-            continue;
-
-        if (c == 255) {
-            if (v.ia8 == 0) {
-                while (l--)
-                    *px++ = v.a8r8g8b8;
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in));
+            float y = nile_Real_tof (nile_Buffer_pop_head (in));
+            x = x < -1e9f ? -1e9f : x > 1e9f ? 1e9f : x;
+            y = y < -1e9f ? -1e9f : y > 1e9f ? 1e9f : y;
+            int xi = (int) x - (x < (int) x);
+            int yi = (int) y - (y < (int) y);
+            xi = gezira_wrap_index (xi, width,  v.xmask, v.mode);
+            yi = gezira_wrap_index (yi, height, v.ymask, v.mode);
+            uint32_t C = pixels[xi + yi * stride];
+            Real a = nile_Real_div (nile_Real (C >> 24),          nile_Real (255));
+            Real r = nile_Real_div (nile_Real ((C >> 16) & 0xff), nile_Real (255));
+            Real g = nile_Real_div (nile_Real ((C >>  8) & 0xff), nile_Real (255));
+            Real b = nile_Real_div (nile_Real ((C >>  0) & 0xff), nile_Real (255));
+            nile_Buffer_push_tail (out, a); nile_Buffer_push_tail (out, r);
+            nile_Buffer_push_tail (out, g); nile_Buffer_push_tail (out, b);
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ReadFromImage_Wrap_ARGB32_body)
+
+static nile_Process_t *
+gezira_ReadFromImage_Wrap_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int mode, int skipNextGate)
+{
+    gezira_ReadFromImage_Wrap_ARGB32_vars_t *vars;
+    nile_Process_t *parent = p;
+    p = nile_Process (p, 2, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ReadFromImage_Wrap_ARGB32_body), NULL);
+    if (p) {
+        int w = mode == GEZIRA_WRAP_REFLECT ? 2 * image->width  : image->width;
+        int h = mode == GEZIRA_WRAP_REFLECT ? 2 * image->height : image->height;
+        vars = nile_Process_vars (p);
+        vars->image = *image;
+        vars->mode  = mode;
+        vars->xmask = (w & (w - 1)) == 0 ? w - 1 : -1;
+        vars->ymask = (h & (h - 1)) == 0 ? h - 1 : -1;
+        p = gezira_Image_sequence (parent, p, image, skipNextGate);
+    }
+    return p;
+}
+
+nile_Process_t *
+gezira_ReadFromImage_Pad_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
+{
+    return gezira_ReadFromImage_Wrap_ARGB32 (p, image, GEZIRA_WRAP_PAD, skipNextGate);
+}
+
+nile_Process_t *
+gezira_ReadFromImage_Repeat_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
+{
+    return gezira_ReadFromImage_Wrap_ARGB32 (p, image, GEZIRA_WRAP_REPEAT, skipNextGate);
+}
+
+nile_Process_t *
+gezira_ReadFromImage_Reflect_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate)
+{
+    return gezira_ReadFromImage_Wrap_ARGB32 (p, image, GEZIRA_WRAP_REFLECT, skipNextGate);
+}
+
+typedef struct {
+    gezira_Image_t  image;
+    int             n;
+    int             min_dx, min_dy, max_dx, max_dy;
+    int             dx[GEZIRA_CONVOLVE_MAX_TAPS];
+    int             dy[GEZIRA_CONVOLVE_MAX_TAPS];
+    float           w[GEZIRA_CONVOLVE_MAX_TAPS];
+} gezira_ConvolveImage_ARGB32_vars_t;
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ConvolveImage_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_ConvolveImage_ARGB32_vars_t *v = nile_Process_vars (p);
+    uint32_t *pixels = v->image.pixels;
+    int       width  = v->image.width;
+    int       height = v->image.height;
+    int       stride = v->image.stride;
+    int       n      = v->n;
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in));
+            float y = nile_Real_tof (nile_Buffer_pop_head (in));
+            int   bx = floorf (x);
+            int   by = floorf (y);
+            float a = 0, r = 0, g = 0, b = 0;
+            int   i;
+            if (bx + v->min_dx >= 0 && bx + v->max_dx < width &&
+                by + v->min_dy >= 0 && by + v->max_dy < height) {
+                uint32_t *px = pixels + bx + by * stride;
+                for (i = 0; i < n; i++) {
+                    uint32_t C = px[v->dx[i] + v->dy[i] * stride];
+                    float    w = v->w[i];
+                    a += w * (C >> 24);
+                    r += w * ((C >> 16) & 0xff);
+                    g += w * ((C >>  8) & 0xff);
+                    b += w * ((C >>  0) & 0xff);
+                }
             }
             else {
-                int32_t *px_ = (int32_t *) px;
-                while (l--) {
-                    int32_t  d  = *px_;
-                    uint8_t  da = d >> 24;
-                    uint8_t  dr = d >> 16;
-                    uint8_t  dg = d >>  8;
-                    uint8_t  db = d >>  0;
-                    uint16_t a  = v.a16 + da * v.ia8;
-                    uint16_t r  = v.r16 + dr * v.ia8;
-                    uint16_t g  = v.g16 + dg * v.ia8;
-                    uint16_t b  = v.b16 + db * v.ia8;
-
-                    a >>= 8;
-                    r >>= 8;
-                    g >>= 8;
-                    b >>= 8;
-
-                    /*
-                    a = (a + (a >> 8)) >> 8;
-                    r = (r + (r >> 8)) >> 8;
-                    g = (g + (g >> 8)) >> 8;
-                    b = (b + (b >> 8)) >> 8;
-                    */
-
-                    *px_++ = (a << 24) | (r << 16) | (g << 8) | (b << 0);
+                for (i = 0; i < n; i++) {
+                    int xi = bx + v->dx[i];
+                    int yi = by + v->dy[i];
+                    xi = xi < 0 ? 0 : xi >= width  ? width  - 1 : xi;
+                    yi = yi < 0 ? 0 : yi >= height ? height - 1 : yi;
+                    uint32_t C = pixels[xi + yi * stride];
+                    float    w = v->w[i];
+                    a += w * (C >> 24);
+                    r += w * ((C >> 16) & 0xff);
+                    g += w * ((C >>  8) & 0xff);
+                    b += w * ((C >>  0) & 0xff);
                 }
             }
+            a = a < 0 ? 0 : a > 1 ? 1 : a;
+            r = r < 0 ? 0 : r > 1 ? 1 : r;
+            g = g < 0 ? 0 : g > 1 ? 1 : g;
+            b = b < 0 ? 0 : b > 1 ? 1 : b;
+            nile_Buffer_push_tail (out, nile_Real (a)); nile_Buffer_push_tail (out, nile_Real (r));
+            nile_Buffer_push_tail (out, nile_Real (g)); nile_Buffer_push_tail (out, nile_Real (b));
         }
-        else {
-            while (l--) {
-                uint32_t d  = *px;
-                uint8_t  da = d >> 24;
-                uint8_t  dr = d >> 16;
-                uint8_t  dg = d >>  8;
-                uint8_t  db = d >>  0;
-                uint16_t a  = v.a8 * c;
-                uint16_t r  = v.r8 * c;
-                uint16_t g  = v.g8 * c;
-                uint16_t b  = v.b8 * c;
-
-                uint16_t ia = (255 * 255 - a) >> 8;
-                a = (a + da * ia) >> 8;
-                r = (r + dr * ia) >> 8;
-                g = (g + dg * ia) >> 8;
-                b = (b + db * ia) >> 8;
-
-                /*
-                uint16_t ia = (255 * 255 - a) + 128;
-                ia = (ia + (ia >> 8)) >> 8;
-                a = a + da * ia + 128;
-                r = r + dr * ia + 128;
-                g = g + dg * ia + 128;
-                b = b + db * ia + 128;
-                a = (a + (a >> 8)) >> 8;
-                r = (r + (r >> 8)) >> 8;
-                g = (g + (g >> 8)) >> 8;
-                b = (b + (b >> 8)) >> 8;
-                */
-
-                *px++ = (a << 24) | (r << 16) | (g << 8) | (b << 0);
-            }
-        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
     }
     return out;
 }
 
+GEZIRA_KERNEL_VARIANTS (gezira_ConvolveImage_ARGB32_body)
+
+/* Each output color is the weighted sum of the n texels at integer offsets
+   (dx[i], dy[i]) from the texel containing the sample point. Taps falling
+   outside the image are clamped to its edge. */
 nile_Process_t *
-gezira_CompositeUniformColorOverImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
-                                              float a, float r, float g, float b)
+gezira_ConvolveImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                             int n, const int *dx, const int *dy, const float *w,
+                             int skipNextGate)
 {
-    gezira_CompositeUniformColorOverImage_ARGB32_vars_t *vars;
+    gezira_ConvolveImage_ARGB32_vars_t *vars;
     nile_Process_t *parent = p;
-    p = nile_Process (p, 4, sizeof (*vars), NULL, gezira_CompositeUniformColorOverImage_ARGB32_body, NULL);
+    if (n < 1 || n > GEZIRA_CONVOLVE_MAX_TAPS)
+        return NULL;
+    p = nile_Process (p, 2, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ConvolveImage_ARGB32_body), NULL);
     if (p) {
-        nile_Process_t *nextGate = nile_Identity (parent, 1);
-
+        int i;
         vars = nile_Process_vars (p);
-        vars->a8 =     a * 255.0f + 0.5f;
-        vars->r8 = a * r * 255.0f + 0.5f;
-        vars->g8 = a * g * 255.0f + 0.5f;
-        vars->b8 = a * b * 255.0f + 0.5f;
-        vars->a16 =     a * 255.0f * 255.0f + 0.5f;
-        vars->r16 = a * r * 255.0f * 255.0f + 0.5f;
-        vars->g16 = a * g * 255.0f * 255.0f + 0.5f;
-        vars->b16 = a * b * 255.0f * 255.0f + 0.5f;
-        vars->a16 += 128;
-        vars->r16 += 128;
-        vars->g16 += 128;
-        vars->b16 += 128;
-        vars->a8r8g8b8 = (vars->a8 << 24) | (vars->r8 << 16) | (vars->g8 << 8) | (vars->b8 << 0);
-        vars->ia8 = 255 - vars->a8;
         vars->image = *image;
-
-        nile_Process_gate (p, nextGate);
-        if (image->gate)
-            p = nile_Process_pipe (image->gate, p, NILE_NULL);
-        image->gate = nextGate;
+        vars->n = n;
+        vars->min_dx = vars->max_dx = dx[0];
+        vars->min_dy = vars->max_dy = dy[0];
+        for (i = 0; i < n; i++) {
+            vars->dx[i] = dx[i];
+            vars->dy[i] = dy[i];
+            vars->w[i]  = w[i] / 255;
+            vars->min_dx = dx[i] < vars->min_dx ? dx[i] : vars->min_dx;
+            vars->max_dx = dx[i] > vars->max_dx ? dx[i] : vars->max_dx;
+            vars->min_dy = dy[i] < vars->min_dy ? dy[i] : vars->min_dy;
+            vars->max_dy = dy[i] > vars->max_dy ? dy[i] : vars->max_dy;
+        }
+        p = gezira_Image_sequence (parent, p, image, skipNextGate);
     }
     return p;
 }
+
+/* Same weights as the GaussianBlurNx1 kernels (binomial coefficients
+   flattened by f), for any odd n up to GEZIRA_CONVOLVE_MAX_TAPS. */
+nile_Process_t *
+gezira_GaussianBlurImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                 int n, float f, int vertical, int skipNextGate)
+{
+    int   dx[GEZIRA_CONVOLVE_MAX_TAPS];
+    int   dy[GEZIRA_CONVOLVE_MAX_TAPS];
+    float w[GEZIRA_CONVOLVE_MAX_TAPS];
+    float c = 1, a, s;
+    int   i;
+    if (n < 1 || n > GEZIRA_CONVOLVE_MAX_TAPS || n % 2 == 0)
+        return NULL;
+    for (i = 1; i < n; i++)
+        c *= 2;
+    a = c * f;
+    s = c + n * a;
+    c = 1;
+    for (i = 0; i < n; i++) {
+        dx[i] = vertical ? 0 : i - n / 2;
+        dy[i] = vertical ? i - n / 2 : 0;
+        w[i]  = (a + c) / s;
+        c = c * (n - 1 - i) / (i + 1);
+    }
+    return gezira_ConvolveImage_ARGB32 (p, image, n, dx, dy, w, skipNextGate);
+}
@@ -3,12 +3,15 @@
 
 #include "nile.h"
 
+#define GEZIRA_CONVOLVE_MAX_TAPS 25
+
 typedef struct {
     void           *pixels;
     int             width;
     int             height;
     int             stride;
     nile_Process_t *gate;
+    unsigned int    version;
 } gezira_Image_t;
 
 void
@@ -20,6 +23,16 @@ gezira_Image_done (gezira_Image_t *image);
 void
 gezira_Image_reset_gate (gezira_Image_t *image);
 
+/* Orders p after the image's previous user and makes it the one the next
+   user waits on. For kernels that read or write an image. */
+nile_Process_t *
+gezira_Image_sequence (nile_Process_t *parent, nile_Process_t *p,
+                       gezira_Image_t *image, int skipNextGate);
+
+/* Pixel formats are named by channel order from the most to the least
+   significant bits of a native-endian pixel word, with premultiplied
+   color. XRGB32 and RGB16_565 are opaque; A8 holds alpha only. */
+
 nile_Process_t *
 gezira_ReadFromImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
 
@@ -30,4 +43,90 @@ nile_Process_t *
 gezira_CompositeUniformColorOverImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
                                               float a, float r, float g, float b);
 
+nile_Process_t *
+gezira_ReadFromImage_ABGR32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_WriteToImage_ABGR32 (nile_Process_t *p, gezira_Image_t *image);
+
+nile_Process_t *
+gezira_CompositeUniformColorOverImage_ABGR32 (nile_Process_t *p, gezira_Image_t *image,
+                                              float a, float r, float g, float b);
+
+nile_Process_t *
+gezira_ReadFromImage_RGBA32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_WriteToImage_RGBA32 (nile_Process_t *p, gezira_Image_t *image);
+
+nile_Process_t *
+gezira_CompositeUniformColorOverImage_RGBA32 (nile_Process_t *p, gezira_Image_t *image,
+                                              float a, float r, float g, float b);
+
+nile_Process_t *
+gezira_ReadFromImage_BGRA32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_WriteToImage_BGRA32 (nile_Process_t *p, gezira_Image_t *image);
+
+nile_Process_t *
+gezira_CompositeUniformColorOverImage_BGRA32 (nile_Process_t *p, gezira_Image_t *image,
+                                              float a, float r, float g, float b);
+
+nile_Process_t *
+gezira_ReadFromImage_XRGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_WriteToImage_XRGB32 (nile_Process_t *p, gezira_Image_t *image);
+
+nile_Process_t *
+gezira_CompositeUniformColorOverImage_XRGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                              float a, float r, float g, float b);
+
+nile_Process_t *
+gezira_ReadFromImage_A8 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_WriteToImage_A8 (nile_Process_t *p, gezira_Image_t *image);
+
+nile_Process_t *
+gezira_CompositeUniformColorOverImage_A8 (nile_Process_t *p, gezira_Image_t *image,
+                                          float a, float r, float g, float b);
+
+nile_Process_t *
+gezira_ReadFromImage_RGB16_565 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_WriteToImage_RGB16_565 (nile_Process_t *p, gezira_Image_t *image);
+
+nile_Process_t *
+gezira_CompositeUniformColorOverImage_RGB16_565 (nile_Process_t *p, gezira_Image_t *image,
+                                                 float a, float r, float g, float b);
+
+nile_Process_t *
+gezira_ReadFromImage_Bicubic_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_ReadFromImage_Bilinear_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+/* Fused PadTexture/RepeatTexture/ReflectTexture (image size) → ReadFromImage */
+
+nile_Process_t *
+gezira_ReadFromImage_Pad_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_ReadFromImage_Repeat_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_ReadFromImage_Reflect_ARGB32 (nile_Process_t *p, gezira_Image_t *image, int skipNextGate);
+
+nile_Process_t *
+gezira_ConvolveImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                             int n, const int *dx, const int *dy, const float *w,
+                             int skipNextGate);
+
+nile_Process_t *
+gezira_GaussianBlurImage_ARGB32 (nile_Process_t *p, gezira_Image_t *image,
+                                 int n, float f, int vertical, int skipNextGate);
+
 #endif
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#define NILE_INCLUDE_PROCESS_API
+#include "nile.h"
+#include "gezira.h"
+#include "gezira-image.h"
+#include "gezira-texture.h"
+#include "gezira-composite.h"
+#include "gezira-layer.h"
+
+struct gezira_LayerBuffer_ {
+    gezira_LayerBuffer_t *next;
+    int                   bucket;
+    uint32_t              pixels[];
+};
+
+void
+gezira_LayerPool_init (gezira_LayerPool_t *pool)
+{
+    int i;
+    for (i = 0; i < GEZIRA_LAYER_POOL_BUCKETS; i++)
+        pool->free[i] = NULL;
+    pool->used = NULL;
+}
+
+static void
+gezira_LayerBuffer_free_all (gezira_LayerBuffer_t *b)
+{
+    while (b) {
+        gezira_LayerBuffer_t *next = b->next;
+        free (b);
+        b = next;
+    }
+}
+
+void
+gezira_LayerPool_done (gezira_LayerPool_t *pool)
+{
+    int i;
+    for (i = 0; i < GEZIRA_LAYER_POOL_BUCKETS; i++)
+        gezira_LayerBuffer_free_all (pool->free[i]);
+    gezira_LayerBuffer_free_all (pool->used);
+    gezira_LayerPool_init (pool);
+}
+
+void
+gezira_LayerPool_recycle (gezira_LayerPool_t *pool)
+{
+    while (pool->used) {
+        gezira_LayerBuffer_t *b = pool->used;
+        pool->used = b->next;
+        b->next = pool->free[b->bucket];
+        pool->free[b->bucket] = b;
+    }
+}
+
+static uint32_t *
+gezira_LayerPool_acquire (gezira_LayerPool_t *pool, size_t npixels)
+{
+    gezira_LayerBuffer_t *b;
+    int bucket = 0;
+    while (((size_t) 1 << bucket) < npixels)
+        bucket++;
+    if (bucket >= GEZIRA_LAYER_POOL_BUCKETS)
+        return NULL;
+    b = pool->free[bucket];
+    if (b)
+        pool->free[bucket] = b->next;
+    else {
+        b = malloc (sizeof (*b) + ((size_t) 1 << bucket) * sizeof (uint32_t));
+        if (!b)
+            return NULL;
+        b->bucket = bucket;
+    }
+    b->next = pool->used;
+    pool->used = b;
+    return b->pixels;
+}
+
+int
+gezira_Layer_init (gezira_Layer_t *layer, gezira_LayerPool_t *pool, gezira_Image_t *dst,
+                   float min_x, float min_y, float max_x, float max_y)
+{
+    int x0 = min_x > 0 ? (int) floorf (min_x) : 0;
+    int y0 = min_y > 0 ? (int) floorf (min_y) : 0;
+    int x1 = max_x < dst->width  ? (int) ceilf (max_x) : dst->width;
+    int y1 = max_y < dst->height ? (int) ceilf (max_y) : dst->height;
+    uint32_t *pixels;
+    if (x1 <= x0 || y1 <= y0)
+        return 0;
+    pixels = gezira_LayerPool_acquire (pool, (size_t) (x1 - x0) * (y1 - y0));
+    if (!pixels)
+        return 0;
+    memset (pixels, 0, (size_t) (x1 - x0) * (y1 - y0) * sizeof (uint32_t));
+    gezira_Image_init (&layer->image, pixels, x1 - x0, y1 - y0, x1 - x0);
+    layer->x = x0;
+    layer->y = y0;
+    return 1;
+}
+
+nile_Process_t *
+gezira_CompositeLayer_ARGB32 (nile_Process_t *p, gezira_Layer_t *layer, gezira_Image_t *dst,
+                              float opacity, int op)
+{
+    gezira_Image_t *image = &layer->image;
+    nile_Process_t *spans = gezira_RectangleSpans (p, layer->x, layer->y,
+                                                   layer->x + image->width,
+                                                   layer->y + image->height);
+    nile_Process_t *composite = gezira_CompositeImageIntoImage_ARGB32 (p, dst, image,
+                                                                       layer->x, layer->y,
+                                                                       opacity, op);
+    if (!spans || !composite)
+        return NULL;
+    return nile_Process_pipe (spans, composite, NILE_NULL);
+}
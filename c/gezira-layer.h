@@ -0,0 +1,47 @@
+#ifndef GEZIRA_LAYER_H
+#define GEZIRA_LAYER_H
+
+#include "nile.h"
+#include "gezira-image.h"
+
+#define GEZIRA_LAYER_POOL_BUCKETS 32
+
+typedef struct gezira_LayerBuffer_ gezira_LayerBuffer_t;
+
+/* Offscreen ARGB32 buffers, kept in power-of-two size classes. Buffers
+   handed out during a frame go back to their class on recycle, which must
+   follow the nile_sync that finishes the frame. */
+typedef struct {
+    gezira_LayerBuffer_t *free[GEZIRA_LAYER_POOL_BUCKETS];
+    gezira_LayerBuffer_t *used;
+} gezira_LayerPool_t;
+
+/* A transparent offscreen image covering the group's bounds. Shapes are
+   drawn into image translated by (-x, -y). */
+typedef struct {
+    gezira_Image_t  image;
+    int             x, y;
+} gezira_Layer_t;
+
+void
+gezira_LayerPool_init (gezira_LayerPool_t *pool);
+
+void
+gezira_LayerPool_done (gezira_LayerPool_t *pool);
+
+void
+gezira_LayerPool_recycle (gezira_LayerPool_t *pool);
+
+/* Bounds are clipped to dst. Returns 0 if they are empty or no buffer could
+   be allocated. */
+int
+gezira_Layer_init (gezira_Layer_t *layer, gezira_LayerPool_t *pool, gezira_Image_t *dst,
+                   float min_x, float min_y, float max_x, float max_y);
+
+/* Composites the layer into dst once everything drawn into it has
+   finished. Feed the result with no input. */
+nile_Process_t *
+gezira_CompositeLayer_ARGB32 (nile_Process_t *p, gezira_Layer_t *layer, gezira_Image_t *dst,
+                              float opacity, int op);
+
+#endif
@@ -0,0 +1,552 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#define NILE_INCLUDE_PROCESS_API
+#include "nile.h"
+#include "gezira-cpu.h"
+#include "gezira.h"
+#include "gezira-bezier.h"
+#include "gezira-rasterize.h"
+
+typedef struct {
+    float *carry;
+    int    row0, rows, next;
+    float  x0, x1, w0, w1;
+    int    started;
+    float  x, y, A, H;
+} gezira_CombineEdgeSamples_Carried_vars_t;
+
+static inline void
+gezira_push_span (nile_Process_t *p, nile_Buffer_t **out, float x, float y, float c, float l)
+{
+    if (nile_Buffer_tailroom (*out) < 4)
+        *out = nile_Process_append_output (p, *out);
+    c = fabsf (c);
+    nile_Buffer_push_tail (*out, nile_Real (x));
+    nile_Buffer_push_tail (*out, nile_Real (y));
+    nile_Buffer_push_tail (*out, nile_Real (c < 1 ? c : 1));
+    nile_Buffer_push_tail (*out, nile_Real (l));
+}
+
+/* Pushes coverage h from column x to the box's right column, covering
+   only the parts of the box's end columns inside the box */
+static void
+gezira_push_height (nile_Process_t *p, nile_Buffer_t **out,
+                    gezira_CombineEdgeSamples_Carried_vars_t *v, float x, float y, float h)
+{
+    if (x == v->x0 && v->w0 < 1) {
+        if (x == v->x1) {
+            gezira_push_span (p, out, x, y, h * (v->w0 + v->w1 - 1), 1);
+            return;
+        }
+        gezira_push_span (p, out, x++, y, h * v->w0, 1);
+    }
+    if (v->w1 < 1) {
+        if (x < v->x1)
+            gezira_push_span (p, out, x, y, h, v->x1 - x);
+        gezira_push_span (p, out, v->x1, y, h * v->w1, 1);
+    }
+    else
+        gezira_push_span (p, out, x, y, h, v->x1 - x + 1);
+}
+
+/* Emits the rows before row that only have a carry */
+static void
+gezira_carry_rows (nile_Process_t *p, nile_Buffer_t **out,
+                   gezira_CombineEdgeSamples_Carried_vars_t *v, int row)
+{
+    row = row < v->rows ? row : v->rows;
+    for (; v->next < row; v->next++)
+        if (fabsf (v->carry[v->next]) > 1e-3f)
+            gezira_push_height (p, out, v, v->x0, v->row0 + v->next + 0.5f, v->carry[v->next]);
+}
+
+/* Winding still open in the right column only covers it up to the box */
+static void
+gezira_end_row (nile_Process_t *p, nile_Buffer_t **out, gezira_CombineEdgeSamples_Carried_vars_t *v)
+{
+    if (v->x == v->x1)
+        v->A -= (1 - v->w1) * v->H;
+    gezira_push_span (p, out, v->x, v->y, v->A, 1);
+    if (fabsf (v->H) > 1e-3f && v->x < v->x1)
+        gezira_push_height (p, out, v, v->x + 1, v->y, v->H);
+}
+
+/* CombineEdgeSamples, starting each row from its carry at the box's left
+   column. The carry covers the left column only right of the box's edge. */
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_CombineEdgeSamples_Carried_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_CombineEdgeSamples_Carried_vars_t *v = nile_Process_vars (p);
+
+    while (in->tail - in->head >= 4) {
+        float x = nile_Real_tof (nile_Buffer_pop_head (in));
+        float y = nile_Real_tof (nile_Buffer_pop_head (in));
+        float a = nile_Real_tof (nile_Buffer_pop_head (in));
+        float h = nile_Real_tof (nile_Buffer_pop_head (in));
+        if (!v->started || y != v->y) {
+            int row = (int) floorf (y) - v->row0;
+            if (v->started)
+                gezira_end_row (p, &out, v);
+            gezira_carry_rows (p, &out, v, row);
+            v->started = 1;
+            v->y = y;
+            if (0 <= row && row < v->rows && v->next == row &&
+                fabsf (v->carry[v->next++]) > 1e-3f) {
+                v->x = v->x0;
+                v->A = v->carry[row] * v->w0;
+                v->H = v->carry[row];
+            }
+            else {
+                v->x = x;
+                v->A = v->H = 0;
+            }
+        }
+        if (x == v->x) {
+            v->A += a;
+            v->H += h;
+        }
+        else {
+            gezira_push_span (p, &out, v->x, v->y, v->A, 1);
+            gezira_push_span (p, &out, v->x + 1, v->y, v->H, x - v->x - 1);
+            v->A = v->H + a;
+            v->H += h;
+            v->x = x;
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_CombineEdgeSamples_Carried_body)
+
+static nile_Buffer_t *
+gezira_CombineEdgeSamples_Carried_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_CombineEdgeSamples_Carried_vars_t *v = nile_Process_vars (p);
+    if (v->started)
+        gezira_end_row (p, &out, v);
+    gezira_carry_rows (p, &out, v, v->rows);
+    free (v->carry);
+    return out;
+}
+
+nile_Process_t *
+gezira_RasterizeClipped (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y)
+{
+    gezira_CombineEdgeSamples_Carried_vars_t *vars;
+    nile_Process_t *combine;
+    int    row0 = (int) floorf (min_y);
+    int    rows = (int) ceilf (max_y) - row0;
+    float *carry;
+
+    rows = rows > 0 ? rows : 0;
+    carry = calloc (rows + 1, sizeof (float));
+    if (!carry)
+        return NULL;
+    combine = nile_Process (p, 4, sizeof (*vars), NULL,
+                            GEZIRA_KERNEL_FOR_CPU (gezira_CombineEdgeSamples_Carried_body),
+                            gezira_CombineEdgeSamples_Carried_epilogue);
+    if (!combine) {
+        free (carry);
+        return NULL;
+    }
+    vars = nile_Process_vars (combine);
+    vars->carry = carry;
+    vars->row0 = row0;
+    vars->rows = rows;
+    vars->next = 0;
+    vars->x0 = floorf (min_x) + 0.5f;
+    vars->x1 = ceilf (max_x) - 0.5f;
+    vars->w0 = floorf (min_x) + 1 - min_x;
+    vars->w1 = max_x - (ceilf (max_x) - 1);
+    vars->started = 0;
+    return nile_Process_pipe (
+        gezira_ClipBeziers_Carry (p, min_x, min_y, max_x, max_y, carry, row0, rows),
+        gezira_DecomposeBeziers (p),
+        nile_SortBy (p, 4, 0),
+        nile_SortBy (p, 4, 1),
+        combine,
+        NILE_NULL);
+}
+
+void
+gezira_SpanClip_init (gezira_SpanClip_t *clip)
+{
+    memset (clip, 0, sizeof (*clip));
+}
+
+void
+gezira_SpanClip_done (gezira_SpanClip_t *clip)
+{
+    if (clip->hold)
+        nile_Process_feed (clip->hold, NULL, 0);
+    free (clip->spans);
+    free (clip->rows);
+    memset (clip, 0, sizeof (*clip));
+}
+
+static nile_Buffer_t *
+gezira_SpanClip_record_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_SpanClip_t *clip = *(gezira_SpanClip_t **) nile_Process_vars (p);
+
+    while (in->tail - in->head >= 4) {
+        float s[4];
+        int   i;
+        for (i = 0; i < 4; i++)
+            s[i] = nile_Real_tof (nile_Buffer_pop_head (in));
+        if (s[2] == 0 || s[3] <= 0 || clip->capacity < 0)
+            continue;
+        if (clip->n + 4 > clip->capacity) {
+            int    capacity = clip->capacity ? clip->capacity * 2 : 1024;
+            float *spans = realloc (clip->spans, capacity * sizeof (float));
+            if (!spans) {
+                clip->capacity = -1;
+                continue;
+            }
+            clip->spans = spans;
+            clip->capacity = capacity;
+        }
+        memcpy (clip->spans + clip->n, s, sizeof (s));
+        clip->n += 4;
+    }
+    return out;
+}
+
+static int
+gezira_span_compare (const void *a_, const void *b_)
+{
+    const float *a = a_, *b = b_;
+    return a[1] != b[1] ? (a[1] < b[1] ? -1 : 1) : a[0] < b[0] ? -1 : a[0] > b[0];
+}
+
+/* Sorts the spans by row and x unless they came sorted, and indexes the
+   first span of each row. A clip that ran out of memory is left empty. */
+static nile_Buffer_t *
+gezira_SpanClip_record_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_SpanClip_t *clip = *(gezira_SpanClip_t **) nile_Process_vars (p);
+    int i, j, n;
+
+    n = clip->capacity < 0 ? 0 : clip->n / 4;
+    clip->n = 0;
+    if (!n)
+        return out;
+    for (i = 1; i < n; i++)
+        if (gezira_span_compare (clip->spans + 4 * (i - 1), clip->spans + 4 * i) > 0)
+            break;
+    if (i < n)
+        qsort (clip->spans, n, 4 * sizeof (float), gezira_span_compare);
+
+    clip->row0 = (int) floorf (clip->spans[1]);
+    clip->nrows = (int) floorf (clip->spans[4 * (n - 1) + 1]) - clip->row0 + 1;
+    clip->rows = malloc ((clip->nrows + 1) * sizeof (int));
+    if (!clip->rows)
+        return out;
+    for (i = j = 0; j <= clip->nrows; j++) {
+        while (i < n && (int) floorf (clip->spans[4 * i + 1]) - clip->row0 < j)
+            i++;
+        clip->rows[j] = i;
+    }
+    clip->n = n;
+    return out;
+}
+
+/* The recording opens a chain of empty tokens, one per user. Each token
+   opens its user's gate and passes its end of stream on to the next token,
+   so every user waits for the recording and nothing else. The last token
+   is held open until the next user links on, or the clip is recorded
+   again or done. */
+nile_Process_t *
+gezira_SpanClip_record (nile_Process_t *p, gezira_SpanClip_t *clip)
+{
+    nile_Process_t *token = nile_Identity (p, 1);
+    free (clip->rows);
+    clip->rows = NULL;
+    clip->n = clip->nrows = 0;
+    clip->capacity = clip->capacity < 0 ? 0 : clip->capacity;
+    if (clip->hold)
+        nile_Process_feed (clip->hold, NULL, 0);
+    clip->gate = clip->hold = NULL;
+
+    p = nile_Process (p, 4, sizeof (clip), NULL,
+                      gezira_SpanClip_record_body, gezira_SpanClip_record_epilogue);
+    if (!p || !token)
+        return NULL;
+    *(gezira_SpanClip_t **) nile_Process_vars (p) = clip;
+    nile_Process_gate (p, token);
+    clip->gate = clip->hold = token;
+    return p;
+}
+
+/* Each span walks the clip spans of its row from the first one that ends
+   past its start */
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ClipSpans_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_SpanClip_t *clip = *(gezira_SpanClip_t **) nile_Process_vars (p);
+
+    while (in->tail - in->head >= 4) {
+        float x = nile_Real_tof (nile_Buffer_pop_head (in));
+        float y = nile_Real_tof (nile_Buffer_pop_head (in));
+        float c = nile_Real_tof (nile_Buffer_pop_head (in));
+        float l = nile_Real_tof (nile_Buffer_pop_head (in));
+        int   row = (int) floorf (y) - clip->row0;
+        int   lo, hi;
+        if (c == 0 || l <= 0 || !clip->n || row < 0 || row >= clip->nrows)
+            continue;
+        lo = clip->rows[row];
+        hi = clip->rows[row + 1];
+        while (lo < hi) {
+            int m = (lo + hi) / 2;
+            if (clip->spans[4 * m] + clip->spans[4 * m + 3] <= x)
+                lo = m + 1;
+            else
+                hi = m;
+        }
+        for (hi = clip->rows[row + 1]; lo < hi && clip->spans[4 * lo] < x + l; lo++) {
+            const float *s = clip->spans + 4 * lo;
+            float x0 = s[0] > x ? s[0] : x;
+            float x1 = s[0] + s[3] < x + l ? s[0] + s[3] : x + l;
+            if (x1 > x0)
+                gezira_push_span (p, &out, x0, y, c * s[2], x1 - x0);
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ClipSpans_body)
+
+nile_Process_t *
+gezira_ClipSpans (nile_Process_t *p, gezira_SpanClip_t *clip)
+{
+    nile_Process_t *parent = p, *gate, *token, *hold;
+    p = nile_Process (p, 4, sizeof (clip), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ClipSpans_body), NULL);
+    if (!p)
+        return NULL;
+    *(gezira_SpanClip_t **) nile_Process_vars (p) = clip;
+    if (!clip->gate)
+        return p;
+    gate  = nile_Identity (parent, 1);
+    token = nile_Identity (parent, 1);
+    hold  = nile_Identity (parent, 1);
+    if (!gate || !token || !hold)
+        return NULL;
+    nile_Process_gate (clip->gate, gate);
+    nile_Process_pipe (clip->gate, token, NILE_NULL);
+    nile_Process_gate (hold, token);
+    nile_Process_feed (clip->hold, NULL, 0);
+    clip->gate = token;
+    clip->hold = hold;
+    return nile_Process_pipe (gate, p, NILE_NULL);
+}
+
+typedef struct {
+    int   pending;
+    float x, y, q, l;
+} gezira_CoalesceSpans_vars_t;
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_CoalesceSpans_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_CoalesceSpans_vars_t *v = nile_Process_vars (p);
+
+    while (in->tail - in->head >= 4) {
+        float x = nile_Real_tof (nile_Buffer_pop_head (in));
+        float y = nile_Real_tof (nile_Buffer_pop_head (in));
+        float c = nile_Real_tof (nile_Buffer_pop_head (in));
+        float l = nile_Real_tof (nile_Buffer_pop_head (in));
+        float q = floorf (fminf (fabsf (c), 1) * GEZIRA_COALESCE_LEVELS + 0.5f);
+        if (q == 0 || l <= 0)
+            continue;
+        if (v->pending && y == v->y && x == v->x + v->l && q == v->q) {
+            v->l += l;
+            continue;
+        }
+        if (v->pending)
+            gezira_push_span (p, &out, v->x, v->y, v->q / GEZIRA_COALESCE_LEVELS, v->l);
+        v->pending = 1;
+        v->x = x;
+        v->y = y;
+        v->q = q;
+        v->l = l;
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_CoalesceSpans_body)
+
+static nile_Buffer_t *
+gezira_CoalesceSpans_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_CoalesceSpans_vars_t *v = nile_Process_vars (p);
+    if (v->pending)
+        gezira_push_span (p, &out, v->x, v->y, v->q / GEZIRA_COALESCE_LEVELS, v->l);
+    return out;
+}
+
+nile_Process_t *
+gezira_CoalesceSpans (nile_Process_t *p)
+{
+    gezira_CoalesceSpans_vars_t *vars;
+    p = nile_Process (p, 4, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_CoalesceSpans_body),
+                      gezira_CoalesceSpans_epilogue);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->pending = 0;
+    }
+    return p;
+}
+
+typedef struct {
+    double cx, cy, hw, hh, rx, ry;
+} gezira_Shape_t;
+
+/* ∫ √(1 - t²) dt, for t clamped to [-1, 1] */
+static double
+gezira_disc_integral (double t)
+{
+    t = t < -1 ? -1 : t > 1 ? 1 : t;
+    return (t * sqrt (1 - t * t) + asin (t)) / 2;
+}
+
+/* Area of the unit disc where X < x and Y < y. Across |t| > √(1 - y²)
+   the disc is thinner than |y|, so Y < y holds all of it or none. */
+static double
+gezira_disc_corner_area (double x, double y)
+{
+    double w, t, a = 0;
+    if (x <= -1 || y <= -1)
+        return 0;
+    if (y >= 1)
+        return 2 * (gezira_disc_integral (x) - gezira_disc_integral (-1));
+    w = sqrt (1 - y * y);
+    if (y > 0) {
+        a += 2 * (gezira_disc_integral (x < -w ? x : -w) - gezira_disc_integral (-1));
+        if (x > w)
+            a += 2 * (gezira_disc_integral (x) - gezira_disc_integral (w));
+    }
+    t = x < w ? x : w;
+    if (t > -w)
+        a += y * (t + w) + gezira_disc_integral (t) - gezira_disc_integral (-w);
+    return a;
+}
+
+static double
+gezira_disc_rect_area (double x0, double y0, double x1, double y1)
+{
+    if (x1 <= x0 || y1 <= y0)
+        return 0;
+    return gezira_disc_corner_area (x1, y1) - gezira_disc_corner_area (x0, y1) -
+           gezira_disc_corner_area (x1, y0) + gezira_disc_corner_area (x0, y0);
+}
+
+/* The rectangle's area in the pixel, with each corner box's share traded
+   for its quarter ellipse's */
+static double
+gezira_Shape_coverage (const gezira_Shape_t *s, double px, double py)
+{
+    double x0 = fmax (px, s->cx - s->hw), x1 = fmin (px + 1, s->cx + s->hw);
+    double y0 = fmax (py, s->cy - s->hh), y1 = fmin (py + 1, s->cy + s->hh);
+    double a;
+    int    i;
+    if (x1 <= x0 || y1 <= y0)
+        return 0;
+    a = (x1 - x0) * (y1 - y0);
+    if (s->rx <= 0)
+        return a;
+    for (i = 0; i < 4; i++) {
+        double sx = i & 1 ? 1 : -1, sy = i & 2 ? 1 : -1;
+        double ex = s->cx + sx * (s->hw - s->rx), ey = s->cy + sy * (s->hh - s->ry);
+        double bx0 = fmax (x0, sx > 0 ? ex : s->cx - s->hw), bx1 = fmin (x1, sx > 0 ? s->cx + s->hw : ex);
+        double by0 = fmax (y0, sy > 0 ? ey : s->cy - s->hh), by1 = fmin (y1, sy > 0 ? s->cy + s->hh : ey);
+        if (bx1 <= bx0 || by1 <= by0)
+            continue;
+        a -= (bx1 - bx0) * (by1 - by0);
+        a += s->rx * s->ry * gezira_disc_rect_area ((bx0 - ex) / s->rx, (by0 - ey) / s->ry,
+                                                    (bx1 - ex) / s->rx, (by1 - ey) / s->ry);
+    }
+    return a;
+}
+
+/* Half the shape's width at y */
+static double
+gezira_Shape_half_width (const gezira_Shape_t *s, double y)
+{
+    double d = fabs (y - s->cy) - (s->hh - s->ry);
+    if (s->ry <= 0 || d <= 0)
+        return s->hw;
+    d /= s->ry;
+    return s->hw - s->rx + s->rx * sqrt (d < 1 ? 1 - d * d : 0);
+}
+
+static nile_Buffer_t *
+gezira_ShapeSpans_prologue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_Shape_t *s = nile_Process_vars (p);
+    int j, j1 = (int) ceil (s->cy + s->hh);
+
+    if (s->hw <= 0 || s->hh <= 0)
+        return out;
+    for (j = (int) floor (s->cy - s->hh); j < j1; j++) {
+        double y0 = fmax (j, s->cy - s->hh), y1 = fmin (j + 1, s->cy + s->hh);
+        double near = s->cy < y0 ? y0 : s->cy > y1 ? y1 : s->cy;
+        double far = s->cy - y0 > y1 - s->cy ? y0 : y1;
+        double wmax = gezira_Shape_half_width (s, near), wmin = gezira_Shape_half_width (s, far);
+        int    i = (int) floor (s->cx - wmax), i1 = (int) ceil (s->cx + wmax);
+        int    in0 = (int) ceil (s->cx - wmin), in1 = (int) floor (s->cx + wmin);
+        for (; i < i1; i++) {
+            double c;
+            if (i == in0 && in0 < in1) {
+                gezira_push_span (p, &out, i + 0.5f, j + 0.5f, y1 - y0, in1 - in0);
+                i = in1 - 1;
+                continue;
+            }
+            c = gezira_Shape_coverage (s, i, j);
+            if (c > 1e-6)
+                gezira_push_span (p, &out, i + 0.5f, j + 0.5f, c, 1);
+        }
+    }
+    return out;
+}
+
+static nile_Buffer_t *
+gezira_ShapeSpans_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    in->head = in->tail;
+    return out;
+}
+
+nile_Process_t *
+gezira_RoundedRectSpans (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y,
+                         float rx, float ry)
+{
+    gezira_Shape_t *s;
+    p = nile_Process (p, 4, sizeof (*s), gezira_ShapeSpans_prologue, gezira_ShapeSpans_body, NULL);
+    if (p) {
+        s = nile_Process_vars (p);
+        s->cx = ((double) min_x + max_x) / 2;
+        s->cy = ((double) min_y + max_y) / 2;
+        s->hw = max_x > min_x ? ((double) max_x - min_x) / 2 : 0;
+        s->hh = max_y > min_y ? ((double) max_y - min_y) / 2 : 0;
+        s->rx = rx < s->hw ? rx : s->hw;
+        s->ry = ry < s->hh ? ry : s->hh;
+        if (!(s->rx > 0 && s->ry > 0))
+            s->rx = s->ry = 0;
+    }
+    return p;
+}
+
+nile_Process_t *
+gezira_RectSpans (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y)
+{
+    return gezira_RoundedRectSpans (p, min_x, min_y, max_x, max_y, 0, 0);
+}
+
+nile_Process_t *
+gezira_EllipseSpans (nile_Process_t *p, float cx, float cy, float rx, float ry)
+{
+    return gezira_RoundedRectSpans (p, cx - rx, cy - ry, cx + rx, cy + ry, rx, ry);
+}
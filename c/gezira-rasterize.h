@@ -0,0 +1,68 @@
+#ifndef GEZIRA_RASTERIZE_H
+#define GEZIRA_RASTERIZE_H
+
+#include "nile.h"
+
+/* ClipBeziers (min, max) → Rasterize, with geometry off the left of the
+   box reduced to per-row winding carries that the span generator starts
+   each row from, and the rest of the off-box geometry dropped. Rows with
+   only a carry become one span across the box, and fills that are still
+   open at the end of a row run to the right edge. Carries and open fills
+   cover a column the box only partly spans by the part inside the box. */
+nile_Process_t *
+gezira_RasterizeClipped (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y);
+
+/* A clip path's CoverageSpans, held by row so that fills can be clipped
+   to it span by span instead of through a mask image. Spans of a row must
+   not overlap, as with those from Rasterize. */
+typedef struct {
+    float          *spans;
+    int             n, capacity;
+    int            *rows;
+    int             row0, nrows;
+    nile_Process_t *gate, *hold;
+} gezira_SpanClip_t;
+
+void
+gezira_SpanClip_init (gezira_SpanClip_t *clip);
+
+/* Must follow the nile_sync that finishes the clip's last user */
+void
+gezira_SpanClip_done (gezira_SpanClip_t *clip);
+
+/* Consumes the clip path's CoverageSpans, replacing any recorded before.
+   Users of the previous recording must have finished. */
+nile_Process_t *
+gezira_SpanClip_record (nile_Process_t *p, gezira_SpanClip_t *clip);
+
+/* Intersects CoverageSpans with the clip, splitting them at the clip's
+   span ends and multiplying coverages. Waits for the recording to finish,
+   and for nothing else; users of one clip run side by side. */
+nile_Process_t *
+gezira_ClipSpans (nile_Process_t *p, gezira_SpanClip_t *clip);
+
+#define GEZIRA_COALESCE_LEVELS 255
+
+/* Merges runs of CoverageSpans on a row that touch and have the same
+   coverage once rounded to GEZIRA_COALESCE_LEVELS levels, and drops the
+   spans that round to none. Coverage comes out rounded. */
+nile_Process_t *
+gezira_CoalesceSpans (nile_Process_t *p);
+
+/* CoverageSpans of axis-aligned shapes, with each edge pixel covered by
+   the exact area of the shape inside it instead of going through beziers
+   and Rasterize. Edge pixels get a span each, and the run between them
+   that the shape covers for the row's full height gets one. Corners of a
+   rounded rectangle are quarter ellipses of radii rx and ry. Feed the
+   result with no input. */
+nile_Process_t *
+gezira_RectSpans (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y);
+
+nile_Process_t *
+gezira_RoundedRectSpans (nile_Process_t *p, float min_x, float min_y, float max_x, float max_y,
+                         float rx, float ry);
+
+nile_Process_t *
+gezira_EllipseSpans (nile_Process_t *p, float cx, float cy, float rx, float ry);
+
+#endif
@@ -0,0 +1,1102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#define NILE_INCLUDE_PROCESS_API
+#include "nile.h"
+#include "gezira.h"
+#include "gezira-stroke.h"
+
+/* Deepest subdivision of one offset curve or join; deeper ones are emitted
+   as they are. */
+#define GEZIRA_STROKE_MAX_DEPTH 16
+
+typedef struct {
+    float x, y;
+} gezira_Point_t;
+
+typedef struct {
+    gezira_Point_t A, B, C;
+} gezira_Bezier_t;
+
+typedef struct {
+    nile_Process_t *p;
+    nile_Buffer_t  *out;
+} gezira_Emitter_t;
+
+static inline gezira_Point_t
+gezira_Point (float x, float y)
+{
+    gezira_Point_t P = {x, y};
+    return P;
+}
+
+static inline gezira_Bezier_t
+gezira_Bezier_reverse (gezira_Bezier_t Z)
+{
+    gezira_Bezier_t R = {Z.C, Z.B, Z.A};
+    return R;
+}
+
+static inline gezira_Point_t
+gezira_Point_mid (gezira_Point_t A, gezira_Point_t B)
+{
+    return gezira_Point ((A.x + B.x) / 2, (A.y + B.y) / 2);
+}
+
+static inline gezira_Point_t
+gezira_Point_offset (gezira_Point_t P, float o, gezira_Point_t u)
+{
+    return gezira_Point (P.x + o * u.x, P.y + o * u.y);
+}
+
+static inline float
+gezira_Point_dot (gezira_Point_t u, gezira_Point_t v)
+{
+    return u.x * v.x + u.y * v.y;
+}
+
+static inline int
+gezira_Point_eq (gezira_Point_t A, gezira_Point_t B)
+{
+    return A.x == B.x && A.y == B.y;
+}
+
+/* (P, P, P), which ends the current subpath */
+static inline int
+gezira_Bezier_is_move (gezira_Bezier_t Z)
+{
+    return gezira_Point_eq (Z.A, Z.B) && gezira_Point_eq (Z.B, Z.C);
+}
+
+/* A ⟂ B */
+static inline gezira_Point_t
+gezira_Point_perp (gezira_Point_t A, gezira_Point_t B)
+{
+    gezira_Point_t u = gezira_Point (A.y - B.y, B.x - A.x);
+    float n = sqrtf (gezira_Point_dot (u, u));
+    return n != 0 ? gezira_Point (u.x / n, u.y / n) : gezira_Point (0, 0);
+}
+
+static inline void
+gezira_emit (gezira_Emitter_t *e, gezira_Point_t A, gezira_Point_t B, gezira_Point_t C)
+{
+    if (nile_Buffer_tailroom (e->out) < 6)
+        e->out = nile_Process_append_output (e->p, e->out);
+    nile_Buffer_push_tail (e->out, nile_Real (A.x));
+    nile_Buffer_push_tail (e->out, nile_Real (A.y));
+    nile_Buffer_push_tail (e->out, nile_Real (B.x));
+    nile_Buffer_push_tail (e->out, nile_Real (B.y));
+    nile_Buffer_push_tail (e->out, nile_Real (C.x));
+    nile_Buffer_push_tail (e->out, nile_Real (C.y));
+}
+
+static void
+gezira_offset_bezier (gezira_Emitter_t *e, float o, gezira_Bezier_t Z)
+{
+    gezira_Bezier_t stack[GEZIRA_STROKE_MAX_DEPTH + 1];
+    int             depth[GEZIRA_STROKE_MAX_DEPTH + 1];
+    int             n = 0;
+
+    stack[n] = Z; depth[n++] = 0;
+    while (n) {
+        gezira_Bezier_t Z = stack[--n];
+        int             d = depth[n];
+        gezira_Point_t  u = gezira_Point_perp (Z.A, Z.B);
+        gezira_Point_t  v = gezira_Point_perp (Z.B, Z.C);
+        gezira_Point_t  AB = gezira_Point_mid (Z.A, Z.B);
+        gezira_Point_t  BC = gezira_Point_mid (Z.B, Z.C);
+        gezira_Point_t  M = gezira_Point_mid (AB, BC);
+        if (gezira_Point_dot (u, v) >= 0.9f || d == GEZIRA_STROKE_MAX_DEPTH) {
+            gezira_Point_t w = gezira_Point_perp (AB, BC);
+            gezira_Point_t D = gezira_Point_offset (Z.A, o, u);
+            gezira_Point_t F = gezira_Point_offset (Z.C, o, v);
+            gezira_Point_t N = gezira_Point_offset (M, o, w);
+            gezira_Point_t DF = gezira_Point_mid (D, F);
+            gezira_emit (e, D, gezira_Point (2 * N.x - DF.x, 2 * N.y - DF.y), F);
+        }
+        else {
+            gezira_Bezier_t Z2 = {M, BC, Z.C};
+            gezira_Bezier_t Z1 = {Z.A, AB, M};
+            stack[n] = Z2; depth[n++] = d + 1;
+            stack[n] = Z1; depth[n++] = d + 1;
+        }
+    }
+}
+
+static void
+gezira_round_join (gezira_Emitter_t *e, float o, gezira_Point_t P, gezira_Point_t u, gezira_Point_t v)
+{
+    gezira_Point_t stack[GEZIRA_STROKE_MAX_DEPTH + 1][2];
+    int            depth[GEZIRA_STROKE_MAX_DEPTH + 1];
+    int            n = 0;
+
+    stack[n][0] = u; stack[n][1] = v; depth[n++] = 0;
+    while (n) {
+        gezira_Point_t u = stack[--n][0];
+        gezira_Point_t v = stack[n][1];
+        int            d = depth[n];
+        gezira_Point_t A = gezira_Point_offset (P, o, u);
+        gezira_Point_t C = gezira_Point_offset (P, o, v);
+        gezira_Point_t w = gezira_Point_perp (A, C);
+        w = w.x != 0 || w.y != 0 ? w : u;
+        if (gezira_Point_dot (u, w) >= 0.9f || d == GEZIRA_STROKE_MAX_DEPTH) {
+            gezira_Point_t N = gezira_Point_offset (P, o, w);
+            gezira_Point_t AC = gezira_Point_mid (A, C);
+            gezira_emit (e, A, gezira_Point (2 * N.x - AC.x, 2 * N.y - AC.y), C);
+        }
+        else {
+            stack[n][0] = w; stack[n][1] = v; depth[n++] = d + 1;
+            stack[n][0] = u; stack[n][1] = w; depth[n++] = d + 1;
+        }
+    }
+}
+
+static void
+gezira_miter_join (gezira_Emitter_t *e, float o, float l, gezira_Point_t P, gezira_Point_t u, gezira_Point_t v)
+{
+    gezira_Point_t A = gezira_Point_offset (P, o, u);
+    gezira_Point_t C = gezira_Point_offset (P, o, v);
+    gezira_Point_t w = gezira_Point_perp (A, C);
+    w = w.x != 0 || w.y != 0 ? w : u;
+    if (gezira_Point_dot (u, w) >= 1 / (l > 1 ? l : 1)) {
+        gezira_Point_t M = gezira_Point_offset (P, o / gezira_Point_dot (u, w), w);
+        gezira_emit (e, M, gezira_Point_mid (M, C), C);
+        gezira_emit (e, A, gezira_Point_mid (A, M), M);
+    }
+    else
+        gezira_emit (e, A, gezira_Point_mid (A, C), C);
+}
+
+static void
+gezira_join_beziers (gezira_Emitter_t *e, float o, float l, gezira_Bezier_t Zi, gezira_Bezier_t Zj)
+{
+    gezira_Point_t u = gezira_Point_perp (Zi.B, Zi.C);
+    gezira_Point_t v = gezira_Point_perp (Zj.A, Zj.B);
+    if (l < 0)
+        gezira_round_join (e, o, Zi.C, u, v);
+    else
+        gezira_miter_join (e, o, l, Zi.C, u, v);
+}
+
+static void
+gezira_cap_bezier (gezira_Emitter_t *e, float o, float c, gezira_Bezier_t Z)
+{
+    gezira_Point_t u = gezira_Point_perp (Z.B, Z.C);
+    gezira_Point_t v = gezira_Point (u.y, -u.x);
+    if (c < 0)
+        gezira_round_join (e, o, Z.C, u, gezira_Point (-u.x, -u.y));
+    else {
+        gezira_Point_t D = gezira_Point_offset (Z.C, o, u);
+        gezira_Point_t G = gezira_Point_offset (Z.C, -o, u);
+        gezira_Point_t E = gezira_Point_offset (D, o * c, v);
+        gezira_Point_t F = gezira_Point_offset (G, o * c, v);
+        gezira_emit (e, D, gezira_Point_mid (D, E), E);
+        gezira_emit (e, E, gezira_Point_mid (E, F), F);
+        gezira_emit (e, F, gezira_Point_mid (F, G), G);
+    }
+}
+
+static inline gezira_Bezier_t
+gezira_pop_bezier (nile_Buffer_t *in)
+{
+    gezira_Bezier_t Z;
+    Z.A.x = nile_Real_tof (nile_Buffer_pop_head (in));
+    Z.A.y = nile_Real_tof (nile_Buffer_pop_head (in));
+    Z.B.x = nile_Real_tof (nile_Buffer_pop_head (in));
+    Z.B.y = nile_Real_tof (nile_Buffer_pop_head (in));
+    Z.C.x = nile_Real_tof (nile_Buffer_pop_head (in));
+    Z.C.y = nile_Real_tof (nile_Buffer_pop_head (in));
+    return Z;
+}
+
+/* Subpaths start as in StrokeBezierPath_SinglePass, after a move or at a
+   bezier that does not start where the previous one ended */
+typedef struct {
+    float           o, l, c;
+    int             started;
+    gezira_Bezier_t Z1, Zi;
+    int             moved;
+    gezira_Point_t  P;
+} gezira_StrokeOneSide_Iterative_vars_t;
+
+static void
+gezira_StrokeOneSide_Iterative_finish (gezira_Emitter_t *e, gezira_StrokeOneSide_Iterative_vars_t *v)
+{
+    if (!v->started)
+        return;
+    gezira_offset_bezier (e, v->o, v->Zi);
+    if (gezira_Point_eq (v->Zi.C, v->Z1.A))
+        gezira_join_beziers (e, v->o, v->l, v->Zi, v->Z1);
+    else
+        gezira_cap_bezier (e, v->o, v->c, v->Zi);
+    v->started = 0;
+}
+
+static nile_Buffer_t *
+gezira_StrokeOneSide_Iterative_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_StrokeOneSide_Iterative_vars_t *v = nile_Process_vars (p);
+    gezira_Emitter_t e = {p, out};
+
+    while (in->tail - in->head >= 6) {
+        gezira_Bezier_t Zj = gezira_pop_bezier (in);
+        if (gezira_Bezier_is_move (Zj)) {
+            gezira_StrokeOneSide_Iterative_finish (&e, v);
+            v->moved = 0;
+            continue;
+        }
+        if (v->moved && !gezira_Point_eq (Zj.A, v->P))
+            gezira_StrokeOneSide_Iterative_finish (&e, v);
+        v->moved = 1;
+        v->P = Zj.C;
+        if (!v->started) {
+            v->Z1 = Zj;
+            v->started = 1;
+        }
+        else {
+            gezira_offset_bezier (&e, v->o, v->Zi);
+            gezira_join_beziers (&e, v->o, v->l, v->Zi, Zj);
+        }
+        v->Zi = Zj;
+    }
+    return e.out;
+}
+
+static nile_Buffer_t *
+gezira_StrokeOneSide_Iterative_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_Emitter_t e = {p, out};
+    gezira_StrokeOneSide_Iterative_finish (&e, nile_Process_vars (p));
+    return e.out;
+}
+
+nile_Process_t *
+gezira_StrokeOneSide_Iterative (nile_Process_t *p, float w, float l, float c)
+{
+    gezira_StrokeOneSide_Iterative_vars_t *vars;
+    p = nile_Process (p, 6, sizeof (*vars), NULL,
+                      gezira_StrokeOneSide_Iterative_body,
+                      gezira_StrokeOneSide_Iterative_epilogue);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->o = w / 2;
+        vars->l = l;
+        vars->c = c;
+        vars->started = 0;
+        vars->moved = 0;
+    }
+    return p;
+}
+
+/* SanitizeBezierPath for one bezier: splits cusps, straightens beziers
+   with a degenerate control leg and drops the ones that are a point.
+   Returns how many beziers it wrote to out (at most 2). */
+static int
+gezira_sanitize_bezier (gezira_Bezier_t Z, gezira_Bezier_t *out)
+{
+    gezira_Bezier_t stack[3];
+    int             n = 0, k = 0;
+
+    stack[n++] = Z;
+    while (n) {
+        gezira_Bezier_t Z = stack[--n];
+        gezira_Point_t  u = gezira_Point_perp (Z.A, Z.B);
+        gezira_Point_t  v = gezira_Point_perp (Z.B, Z.C);
+        gezira_Point_t  AC = gezira_Point_mid (Z.A, Z.C);
+        if (gezira_Point_dot (u, v) < -0.9999f) {
+            gezira_Point_t  M = gezira_Point_mid (gezira_Point_mid (Z.A, Z.B),
+                                                  gezira_Point_mid (Z.B, Z.C));
+            gezira_Bezier_t Z2 = {M, gezira_Point_mid (M, Z.C), Z.C};
+            gezira_Bezier_t Z1 = {Z.A, gezira_Point_mid (Z.A, M), M};
+            stack[n++] = Z2;
+            stack[n++] = Z1;
+        }
+        else if (hypotf (Z.A.x - Z.B.x, Z.A.y - Z.B.y) > 0.0001f &&
+                 hypotf (Z.B.x - Z.C.x, Z.B.y - Z.C.y) > 0.0001f) {
+            if (k < 2)
+                out[k++] = Z;
+        }
+        else if (!gezira_Point_eq (AC, Z.B)) {
+            gezira_Bezier_t Z1 = {Z.A, AC, Z.C};
+            stack[n++] = Z1;
+        }
+    }
+    return k;
+}
+
+/* SanitizeBezierPath, passing move records on */
+static nile_Buffer_t *
+gezira_SanitizeBezierPath_Moves_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_Emitter_t e = {p, out};
+
+    while (in->tail - in->head >= 6) {
+        gezira_Bezier_t Z = gezira_pop_bezier (in), S[2];
+        int i, n;
+        if (gezira_Bezier_is_move (Z)) {
+            gezira_emit (&e, Z.A, Z.B, Z.C);
+            continue;
+        }
+        n = gezira_sanitize_bezier (Z, S);
+        for (i = 0; i < n; i++)
+            gezira_emit (&e, S[i].A, S[i].B, S[i].C);
+    }
+    return e.out;
+}
+
+nile_Process_t *
+gezira_StrokeBezierPath_Iterative (nile_Process_t *p, float w, float l, float c)
+{
+    nile_Process_t *side1 = gezira_StrokeOneSide_Iterative (p, w, l, c);
+    nile_Process_t *side2 = nile_Process_pipe (nile_Reverse (p, 6), gezira_ReverseBeziers (p),
+                                               gezira_StrokeOneSide_Iterative (p, w, l, c), NILE_NULL);
+    return nile_Process_pipe (nile_Process (p, 6, 0, NULL, gezira_SanitizeBezierPath_Moves_body, NULL),
+                              nile_DupCat (p, 6, side1, 6, side2, 6), NILE_NULL);
+}
+
+/* Both sides in one pass. Each offset, join and cap of the second side is
+   the one StrokeBezierPath computes on the reversed path, so the outline is
+   the same set of beziers, only in a different order. An input bezier that
+   does not start where the previous one ended, or follows a move, starts a
+   new subpath. */
+
+typedef struct {
+    float           o, l, c;
+    int             started;
+    gezira_Bezier_t Z1, Zi;
+    int             moved;
+    gezira_Point_t  P;
+} gezira_StrokeBothSides_vars_t;
+
+static void
+gezira_StrokeBothSides_add (gezira_Emitter_t *e, gezira_StrokeBothSides_vars_t *v, gezira_Bezier_t Zj)
+{
+    if (!v->started) {
+        v->Z1 = Zj;
+        v->started = 1;
+    }
+    else {
+        gezira_Bezier_t Ri = gezira_Bezier_reverse (v->Zi);
+        gezira_offset_bezier (e, v->o, v->Zi);
+        gezira_join_beziers (e, v->o, v->l, v->Zi, Zj);
+        gezira_offset_bezier (e, v->o, Ri);
+        gezira_join_beziers (e, v->o, v->l, gezira_Bezier_reverse (Zj), Ri);
+    }
+    v->Zi = Zj;
+}
+
+static void
+gezira_StrokeBothSides_finish (gezira_Emitter_t *e, gezira_StrokeBothSides_vars_t *v)
+{
+    gezira_Bezier_t R1 = gezira_Bezier_reverse (v->Z1);
+    gezira_Bezier_t Rn = gezira_Bezier_reverse (v->Zi);
+    if (!v->started)
+        return;
+    gezira_offset_bezier (e, v->o, v->Zi);
+    gezira_offset_bezier (e, v->o, Rn);
+    if (gezira_Point_eq (v->Zi.C, v->Z1.A)) {
+        gezira_join_beziers (e, v->o, v->l, v->Zi, v->Z1);
+        gezira_join_beziers (e, v->o, v->l, R1, Rn);
+    }
+    else {
+        gezira_cap_bezier (e, v->o, v->c, v->Zi);
+        gezira_cap_bezier (e, v->o, v->c, R1);
+    }
+    v->started = 0;
+}
+
+static nile_Buffer_t *
+gezira_StrokeBothSides_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_StrokeBothSides_vars_t *v = nile_Process_vars (p);
+    gezira_Emitter_t e = {p, out};
+
+    while (in->tail - in->head >= 6) {
+        gezira_Bezier_t Z = gezira_pop_bezier (in), S[2];
+        int i, n;
+        if (gezira_Bezier_is_move (Z)) {
+            gezira_StrokeBothSides_finish (&e, v);
+            v->moved = 0;
+            continue;
+        }
+        if (v->moved && !gezira_Point_eq (Z.A, v->P))
+            gezira_StrokeBothSides_finish (&e, v);
+        v->moved = 1;
+        v->P = Z.C;
+        n = gezira_sanitize_bezier (Z, S);
+        for (i = 0; i < n; i++)
+            gezira_StrokeBothSides_add (&e, v, S[i]);
+    }
+    return e.out;
+}
+
+static nile_Buffer_t *
+gezira_StrokeBothSides_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_StrokeBothSides_vars_t *v = nile_Process_vars (p);
+    gezira_Emitter_t e = {p, out};
+    gezira_StrokeBothSides_finish (&e, v);
+    return e.out;
+}
+
+nile_Process_t *
+gezira_StrokeBezierPath_SinglePass (nile_Process_t *p, float w, float l, float c)
+{
+    gezira_StrokeBothSides_vars_t *vars;
+    p = nile_Process (p, 6, sizeof (*vars), NULL,
+                      gezira_StrokeBothSides_body,
+                      gezira_StrokeBothSides_epilogue);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->o = w / 2;
+        vars->l = l;
+        vars->c = c;
+        vars->started = 0;
+        vars->moved = 0;
+    }
+    return p;
+}
+
+typedef struct {
+    int            n, i, on;
+    float          left;
+    int            i0, on0;
+    float          left0;
+    int            moved;
+    gezira_Point_t P;
+    float          dashes[GEZIRA_DASH_MAX];
+} gezira_DashBezierPath_vars_t;
+
+/* The point at t, and the middle control point of the piece from t0 to t1 */
+static inline gezira_Point_t
+gezira_Bezier_blossom (gezira_Bezier_t Z, float t0, float t1)
+{
+    float a = (1 - t0) * (1 - t1), b = (1 - t0) * t1 + t0 * (1 - t1), c = t0 * t1;
+    return gezira_Point (a * Z.A.x + b * Z.B.x + c * Z.C.x,
+                         a * Z.A.y + b * Z.B.y + c * Z.C.y);
+}
+
+static inline float
+gezira_dash_t (const float *length, float s)
+{
+    int i = 0;
+    float d;
+    while (i < GEZIRA_DASH_SAMPLES - 1 && length[i + 1] < s)
+        i++;
+    d = length[i + 1] - length[i];
+    return (i + (d > 0 ? (s - length[i]) / d : 0)) / GEZIRA_DASH_SAMPLES;
+}
+
+/* A zero-length dash at s, as a bezier GEZIRA_DASH_DOT long along the
+   tangent: a point bezier would be a move, which the stroker never caps */
+static inline void
+gezira_dash_dot (gezira_Emitter_t *e, gezira_Bezier_t Z, const float *length, float s)
+{
+    float t = s > 0 ? gezira_dash_t (length, s) : 0;
+    gezira_Point_t P = gezira_Bezier_blossom (Z, t, t);
+    gezira_Point_t T = gezira_Point ((1 - t) * (Z.B.x - Z.A.x) + t * (Z.C.x - Z.B.x),
+                                     (1 - t) * (Z.B.y - Z.A.y) + t * (Z.C.y - Z.B.y));
+    float n;
+    if (T.x == 0 && T.y == 0)
+        T = gezira_Point (Z.C.x - Z.A.x, Z.C.y - Z.A.y);
+    n = hypotf (T.x, T.y);
+    if (n == 0)
+        return;
+    T = gezira_Point (T.x / n * GEZIRA_DASH_DOT / 2, T.y / n * GEZIRA_DASH_DOT / 2);
+    gezira_emit (e, gezira_Point (P.x - T.x, P.y - T.y), P, gezira_Point (P.x + T.x, P.y + T.y));
+}
+
+static nile_Buffer_t *
+gezira_DashBezierPath_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_DashBezierPath_vars_t *v = nile_Process_vars (p);
+    gezira_Emitter_t e = {p, out};
+
+    while (in->tail - in->head >= 6) {
+        gezira_Bezier_t Z = gezira_pop_bezier (in);
+        float length[GEZIRA_DASH_SAMPLES + 1], s = 0, L;
+        gezira_Point_t P = Z.A;
+        int i;
+        if (!v->n || gezira_Bezier_is_move (Z)) {
+            gezira_emit (&e, Z.A, Z.B, Z.C);
+            v->moved = 0;
+            continue;
+        }
+        length[0] = 0;
+        for (i = 1; i <= GEZIRA_DASH_SAMPLES; i++) {
+            float t = (float) i / GEZIRA_DASH_SAMPLES;
+            gezira_Point_t Q = gezira_Bezier_blossom (Z, t, t);
+            length[i] = length[i - 1] + hypotf (Q.x - P.x, Q.y - P.y);
+            P = Q;
+        }
+        L = length[GEZIRA_DASH_SAMPLES];
+        if (!v->moved || !gezira_Point_eq (Z.A, v->P)) {
+            v->i = v->i0;
+            v->on = v->on0;
+            v->left = v->left0;
+            if (v->on && v->left <= 0)
+                gezira_dash_dot (&e, Z, length, 0);
+        }
+        v->moved = 1;
+        v->P = Z.C;
+        while (s < L) {
+            int   last = v->left >= L - s;
+            float d = last ? L - s : v->left;
+            if (v->on && d > 0) {
+                float t0 = s > 0 ? gezira_dash_t (length, s) : 0;
+                float t1 = last ? 1 : gezira_dash_t (length, s + d);
+                gezira_Point_t A = t0 > 0 ? gezira_Bezier_blossom (Z, t0, t0) : Z.A;
+                gezira_Point_t C = last ? Z.C : gezira_Bezier_blossom (Z, t1, t1);
+                gezira_emit (&e, A, gezira_Bezier_blossom (Z, t0, t1), C);
+            }
+            s = last ? L : s + d;
+            v->left -= d;
+            if (v->left <= 0) {
+                v->i = (v->i + 1) % v->n;
+                v->left = v->dashes[v->i];
+                v->on = !v->on;
+                if (v->on && v->left <= 0)
+                    gezira_dash_dot (&e, Z, length, s);
+            }
+        }
+    }
+    return e.out;
+}
+
+nile_Process_t *
+gezira_DashBezierPath (nile_Process_t *p, int n, const float *dashes, float phase)
+{
+    gezira_DashBezierPath_vars_t *vars;
+    float total = 0;
+    int i;
+    p = nile_Process (p, 6, sizeof (*vars), NULL, gezira_DashBezierPath_body, NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        n = n < GEZIRA_DASH_MAX / 2 ? n : GEZIRA_DASH_MAX / 2;
+        for (i = 0; i < n; i++) {
+            vars->dashes[i] = vars->dashes[i + n] = dashes[i] > 0 ? dashes[i] : 0;
+            total += 2 * vars->dashes[i];
+        }
+        vars->n = total > 0 ? (n % 2 ? 2 * n : n) : 0;
+        vars->i = 0;
+        vars->on = 1;
+        if (vars->n) {
+            phase = fmodf (phase, total / (n % 2 ? 1 : 2));
+            if (phase < 0)
+                phase += total / (n % 2 ? 1 : 2);
+            /* Stop at a zero-length dash the phase lands on, so it is drawn */
+            while (phase > vars->dashes[vars->i] ||
+                   (phase == vars->dashes[vars->i] && (phase > 0 || !vars->on))) {
+                phase -= vars->dashes[vars->i];
+                vars->i = (vars->i + 1) % vars->n;
+                vars->on = !vars->on;
+            }
+            vars->left = vars->dashes[vars->i] - phase;
+        }
+        vars->i0 = vars->i;
+        vars->on0 = vars->on;
+        vars->left0 = vars->left;
+        vars->moved = 0;
+    }
+    return p;
+}
+
+#define GEZIRA_HAIRLINE_JOINT_PIXELS 16
+
+typedef struct {
+    float x, y, c;
+    int   keep;
+} gezira_HairlinePixel_t;
+
+/* Pixels around the last segment's end are held in joint until the next
+   segment has added its own coverage of them */
+typedef struct {
+    float                  w;
+    float                  min_x, min_y, max_x, max_y;
+    gezira_Point_t         J;
+    int                    n;
+    gezira_HairlinePixel_t joint[GEZIRA_HAIRLINE_JOINT_PIXELS];
+} gezira_RasterizeHairline_vars_t;
+
+static inline void
+gezira_emit_span (gezira_Emitter_t *e, float x, float y, float c)
+{
+    if (c <= 0)
+        return;
+    if (nile_Buffer_tailroom (e->out) < 4)
+        e->out = nile_Process_append_output (e->p, e->out);
+    nile_Buffer_push_tail (e->out, nile_Real (x));
+    nile_Buffer_push_tail (e->out, nile_Real (y));
+    nile_Buffer_push_tail (e->out, nile_Real (c));
+    nile_Buffer_push_tail (e->out, nile_Real (1));
+}
+
+/* Adds a joint pixel's coverage to the one held, if any. Pixels kept are
+   held for the next segment too. */
+static void
+gezira_hairline_pixel (gezira_Emitter_t *e, gezira_RasterizeHairline_vars_t *v,
+                       float x, float y, float c, int joint, int keep)
+{
+    int i;
+    if (c <= 0)
+        return;
+    if (joint) {
+        for (i = 0; i < v->n; i++)
+            if (v->joint[i].x == x && v->joint[i].y == y) {
+                v->joint[i].c += c;
+                v->joint[i].keep |= keep;
+                return;
+            }
+        if (v->n < GEZIRA_HAIRLINE_JOINT_PIXELS) {
+            gezira_HairlinePixel_t h = {x, y, c, keep};
+            v->joint[v->n++] = h;
+            return;
+        }
+    }
+    gezira_emit_span (e, x, y, c < 1 ? c : 1);
+}
+
+/* Emits the joint pixels not kept, or all of them */
+static void
+gezira_hairline_flush (gezira_Emitter_t *e, gezira_RasterizeHairline_vars_t *v, int all)
+{
+    int i, n = 0;
+    for (i = 0; i < v->n; i++) {
+        gezira_HairlinePixel_t h = v->joint[i];
+        if (h.keep && !all) {
+            h.keep = 0;
+            v->joint[n++] = h;
+        }
+        else
+            gezira_emit_span (e, h.x, h.y, h.c < 1 ? h.c : 1);
+    }
+    v->n = n;
+}
+
+/* Walks the segment along its major axis u, one pixel at a time. Each step
+   covers an interval k = w √(1 + m²) wide on the minor axis v, which is
+   box filtered into the two or three pixels it overlaps. Only pixels in
+   the clip bounds, rounded out to whole pixels, are walked. The steps
+   holding P and Q are joint pixels, shared with the segments before and
+   after. */
+static void
+gezira_hairline_segment (gezira_Emitter_t *e, gezira_RasterizeHairline_vars_t *v,
+                         gezira_Point_t P, gezira_Point_t Q)
+{
+    int   swap = fabsf (Q.y - P.y) > fabsf (Q.x - P.x);
+    float u0 = swap ? P.y : P.x, v0 = swap ? P.x : P.y;
+    float u1 = swap ? Q.y : Q.x, v1 = swap ? Q.x : Q.y;
+    float pu = u0, qu = u1;
+    float min_u = floorf (swap ? v->min_y : v->min_x), max_u = ceilf (swap ? v->max_y : v->max_x);
+    float min_v = floorf (swap ? v->min_x : v->min_y), max_v = ceilf (swap ? v->max_x : v->max_y);
+    float m, k, a, b, i;
+
+    if (u0 > u1) {
+        float t;
+        t = u0; u0 = u1; u1 = t;
+        t = v0; v0 = v1; v1 = t;
+    }
+    if (u0 == u1)
+        return;
+    m = (v1 - v0) / (u1 - u0);
+    k = v->w * sqrtf (1 + m * m);
+    a = u0 > min_u ? u0 : min_u;
+    b = u1 < max_u ? u1 : max_u;
+    if (m != 0) {
+        float ua = u0 + (min_v - k / 2 - v0) / m, ub = u0 + (max_v + k / 2 - v0) / m;
+        if (ua > ub) {
+            float t = ua; ua = ub; ub = t;
+        }
+        a = a > ua ? a : ua;
+        b = b < ub ? b : ub;
+    }
+    else if (v0 + k / 2 <= min_v || max_v <= v0 - k / 2)
+        b = a;
+
+    for (i = floorf (a); i < b; i++) {
+        float ia = a > i ? a : i, ib = b < i + 1 ? b : i + 1;
+        float w = v0 + m * ((ia + ib) / 2 - u0);
+        float lo = w - k / 2, hi = w + k / 2, j;
+        int   at_p = ia <= pu && pu <= ib, at_q = ia <= qu && qu <= ib;
+        for (j = floorf (lo) > min_v ? floorf (lo) : min_v; j < hi && j < max_v; j++) {
+            float c = (ib - ia) * ((hi < j + 1 ? hi : j + 1) - (lo > j ? lo : j));
+            if (swap)
+                gezira_hairline_pixel (e, v, j + 0.5f, i + 0.5f, c, at_p || at_q, at_q);
+            else
+                gezira_hairline_pixel (e, v, i + 0.5f, j + 0.5f, c, at_p || at_q, at_q);
+        }
+    }
+    gezira_hairline_flush (e, v, 0);
+}
+
+static nile_Buffer_t *
+gezira_RasterizeHairline_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_RasterizeHairline_vars_t *v = nile_Process_vars (p);
+    gezira_Emitter_t e = {p, out};
+
+    while (in->tail - in->head >= 6) {
+        gezira_Bezier_t Z = gezira_pop_bezier (in);
+        gezira_Point_t  D = gezira_Point (Z.A.x - 2 * Z.B.x + Z.C.x, Z.A.y - 2 * Z.B.y + Z.C.y);
+        gezira_Point_t  P = Z.A;
+        int n = (int) ceilf (sqrtf (hypotf (D.x, D.y) / (4 * GEZIRA_HAIRLINE_TOLERANCE)));
+        int i;
+        n = n < 1 ? 1 : n < GEZIRA_HAIRLINE_MAX_SEGMENTS ? n : GEZIRA_HAIRLINE_MAX_SEGMENTS;
+        if (P.x != v->J.x || P.y != v->J.y)
+            gezira_hairline_flush (&e, v, 1);
+        for (i = 1; i <= n; i++) {
+            float t = (float) i / n;
+            gezira_Point_t Q = i < n ? gezira_Bezier_blossom (Z, t, t) : Z.C;
+            gezira_hairline_segment (&e, v, P, Q);
+            P = Q;
+        }
+        v->J = P;
+    }
+    return e.out;
+}
+
+static nile_Buffer_t *
+gezira_RasterizeHairline_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_Emitter_t e = {p, out};
+    gezira_hairline_flush (&e, nile_Process_vars (p), 1);
+    return e.out;
+}
+
+nile_Process_t *
+gezira_RasterizeHairline (nile_Process_t *p, float w,
+                          float min_x, float min_y, float max_x, float max_y)
+{
+    gezira_RasterizeHairline_vars_t *vars;
+    p = nile_Process (p, 6, sizeof (*vars), NULL, gezira_RasterizeHairline_body,
+                      gezira_RasterizeHairline_epilogue);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->w = w < 1 ? w : 1;
+        vars->min_x = min_x;
+        vars->min_y = min_y;
+        vars->max_x = max_x;
+        vars->max_y = max_y;
+        vars->n = 0;
+    }
+    return p;
+}
+
+/* The farthest the outline of a stroke reaches from its path's control
+   points. Offset curves and round joins and caps stay within 1.1 o (their
+   control points are pushed out by at most 1 / 0.9), miters within o l and
+   square caps within o √(1 + c²). */
+static float
+gezira_stroke_radius (float w, float l, float c)
+{
+    float o = w / 2, r = 1.1f;
+    if (l > r)
+        r = l;
+    if (c >= 0 && sqrtf (1 + c * c) > r)
+        r = sqrtf (1 + c * c);
+    return o * r;
+}
+
+typedef struct {
+    float r;
+    float min_x, min_y, max_x, max_y;
+} gezira_CalculateStrokeBounds_vars_t;
+
+static inline void
+gezira_bounds_add (gezira_CalculateStrokeBounds_vars_t *v, gezira_Bezier_t Z)
+{
+    if (gezira_Bezier_is_move (Z))
+        return;
+    v->min_x = fminf (v->min_x, fminf (Z.A.x, fminf (Z.B.x, Z.C.x)));
+    v->min_y = fminf (v->min_y, fminf (Z.A.y, fminf (Z.B.y, Z.C.y)));
+    v->max_x = fmaxf (v->max_x, fmaxf (Z.A.x, fmaxf (Z.B.x, Z.C.x)));
+    v->max_y = fmaxf (v->max_y, fmaxf (Z.A.y, fmaxf (Z.B.y, Z.C.y)));
+}
+
+static void
+gezira_bounds_init (gezira_CalculateStrokeBounds_vars_t *v, float w, float l, float c)
+{
+    v->r = gezira_stroke_radius (w, l, c);
+    v->min_x = v->min_y =  999999;
+    v->max_x = v->max_y = -999999;
+}
+
+/* Grows nonempty bounds by the stroke radius */
+static int
+gezira_bounds_finish (gezira_CalculateStrokeBounds_vars_t *v)
+{
+    if (v->min_x > v->max_x)
+        return 0;
+    v->min_x -= v->r;
+    v->min_y -= v->r;
+    v->max_x += v->r;
+    v->max_y += v->r;
+    return 1;
+}
+
+static nile_Buffer_t *
+gezira_CalculateStrokeBounds_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_CalculateStrokeBounds_vars_t *v = nile_Process_vars (p);
+    while (in->tail - in->head >= 6)
+        gezira_bounds_add (v, gezira_pop_bezier (in));
+    return out;
+}
+
+static nile_Buffer_t *
+gezira_CalculateStrokeBounds_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_CalculateStrokeBounds_vars_t *v = nile_Process_vars (p);
+    gezira_bounds_finish (v);
+    if (nile_Buffer_tailroom (out) < 4)
+        out = nile_Process_append_output (p, out);
+    nile_Buffer_push_tail (out, nile_Real (v->min_x));
+    nile_Buffer_push_tail (out, nile_Real (v->min_y));
+    nile_Buffer_push_tail (out, nile_Real (v->max_x));
+    nile_Buffer_push_tail (out, nile_Real (v->max_y));
+    return out;
+}
+
+nile_Process_t *
+gezira_CalculateStrokeBounds (nile_Process_t *p, float w, float l, float c)
+{
+    gezira_CalculateStrokeBounds_vars_t *vars;
+    p = nile_Process (p, 6, sizeof (*vars), NULL,
+                      gezira_CalculateStrokeBounds_body,
+                      gezira_CalculateStrokeBounds_epilogue);
+    if (p) {
+        vars = nile_Process_vars (p);
+        gezira_bounds_init (vars, w, l, c);
+    }
+    return p;
+}
+
+int
+gezira_StrokeBounds (const float *path, int n, float w, float l, float c, float *bounds)
+{
+    gezira_CalculateStrokeBounds_vars_t v;
+    int i;
+    gezira_bounds_init (&v, w, l, c);
+    for (i = 0; i + 6 <= n; i += 6) {
+        gezira_Bezier_t Z = {{path[i], path[i + 1]}, {path[i + 2], path[i + 3]},
+                             {path[i + 4], path[i + 5]}};
+        gezira_bounds_add (&v, Z);
+    }
+    if (!gezira_bounds_finish (&v))
+        return 0;
+    bounds[0] = v.min_x;
+    bounds[1] = v.min_y;
+    bounds[2] = v.max_x;
+    bounds[3] = v.max_y;
+    return 1;
+}
+
+#define GEZIRA_STROKE_CACHE_FREE      0
+#define GEZIRA_STROKE_CACHE_RECORDING 1
+#define GEZIRA_STROKE_CACHE_READY     2
+
+void
+gezira_StrokeCache_init (gezira_StrokeCache_t *cache)
+{
+    memset (cache, 0, sizeof (*cache));
+}
+
+static void
+gezira_StrokeCacheEntry_clear (gezira_StrokeCacheEntry_t *e)
+{
+    free (e->beziers);
+    memset (e, 0, sizeof (*e));
+}
+
+void
+gezira_StrokeCache_done (gezira_StrokeCache_t *cache)
+{
+    int i;
+    for (i = 0; i < GEZIRA_STROKE_CACHE_ENTRIES; i++)
+        gezira_StrokeCacheEntry_clear (&cache->entries[i]);
+    cache->frame = 0;
+}
+
+void
+gezira_StrokeCache_recycle (gezira_StrokeCache_t *cache)
+{
+    int i;
+    for (i = 0; i < GEZIRA_STROKE_CACHE_ENTRIES; i++) {
+        gezira_StrokeCacheEntry_t *e = &cache->entries[i];
+        if (e->state == GEZIRA_STROKE_CACHE_RECORDING) {
+            if (e->recorded > 0)
+                e->state = GEZIRA_STROKE_CACHE_READY;
+            else
+                gezira_StrokeCacheEntry_clear (e);
+        }
+    }
+    cache->frame++;
+}
+
+void
+gezira_StrokeCache_invalidate (gezira_StrokeCache_t *cache, const float *path)
+{
+    int i;
+    for (i = 0; i < GEZIRA_STROKE_CACHE_ENTRIES; i++) {
+        gezira_StrokeCacheEntry_t *e = &cache->entries[i];
+        if (e->path == path) {
+            if (e->last_used == cache->frame + 1)
+                e->path = NULL;
+            else
+                gezira_StrokeCacheEntry_clear (e);
+        }
+    }
+}
+
+/* Copies the stream into the entry; recorded is 1 once it is complete and
+   -1 if it ran out of memory. */
+static nile_Buffer_t *
+gezira_StrokeCache_Record_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_StrokeCacheEntry_t *e = *(gezira_StrokeCacheEntry_t **) nile_Process_vars (p);
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = in->tail - in->head;
+        int o = out->capacity - out->tail;
+        m = m < o ? m : o;
+        if (e->recorded == 0 && e->n + m > e->capacity) {
+            int capacity = e->capacity ? e->capacity : 1024;
+            float *beziers;
+            while (capacity < e->n + m)
+                capacity *= 2;
+            beziers = realloc (e->beziers, capacity * sizeof (float));
+            if (beziers) {
+                e->beziers = beziers;
+                e->capacity = capacity;
+            }
+            else
+                e->recorded = -1;
+        }
+        while (m--) {
+            nile_Real_t r = nile_Buffer_pop_head (in);
+            if (e->recorded == 0)
+                e->beziers[e->n++] = nile_Real_tof (r);
+            nile_Buffer_push_tail (out, r);
+        }
+        if (nile_Buffer_tailroom (out) < 1)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+static nile_Buffer_t *
+gezira_StrokeCache_Record_epilogue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_StrokeCacheEntry_t *e = *(gezira_StrokeCacheEntry_t **) nile_Process_vars (p);
+    if (e->recorded == 0)
+        e->recorded = 1;
+    return out;
+}
+
+static nile_Buffer_t *
+gezira_StrokeCache_Replay_prologue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_StrokeCacheEntry_t *e = *(gezira_StrokeCacheEntry_t **) nile_Process_vars (p);
+    int i;
+    for (i = 0; i < e->n; i++) {
+        if (nile_Buffer_tailroom (out) < 1)
+            out = nile_Process_append_output (p, out);
+        nile_Buffer_push_tail (out, nile_Real (e->beziers[i]));
+    }
+    return out;
+}
+
+static nile_Buffer_t *
+gezira_StrokeCache_Replay_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    in->head = in->tail;
+    return out;
+}
+
+static nile_Process_t *
+gezira_StrokeCache_process (nile_Process_t *p, gezira_StrokeCacheEntry_t *e, int replay)
+{
+    p = replay ? nile_Process (p, 1, sizeof (e), gezira_StrokeCache_Replay_prologue,
+                               gezira_StrokeCache_Replay_body, NULL)
+               : nile_Process (p, 1, sizeof (e), NULL,
+                               gezira_StrokeCache_Record_body,
+                               gezira_StrokeCache_Record_epilogue);
+    if (p)
+        *(gezira_StrokeCacheEntry_t **) nile_Process_vars (p) = e;
+    return p;
+}
+
+/* The effective scale of M if it is a (possibly reflected) similarity,
+   or 0 */
+static float
+gezira_similarity_scale (float a, float b, float c, float d)
+{
+    float eps = 1e-5f * (fabsf (a) + fabsf (b) + fabsf (c) + fabsf (d));
+    if (!((fabsf (a - d) <= eps && fabsf (b + c) <= eps) ||
+          (fabsf (a + d) <= eps && fabsf (b - c) <= eps)))
+        return 0;
+    return sqrtf (a * a + b * b);
+}
+
+nile_Process_t *
+gezira_StrokeCache_stroke (nile_Process_t *p, gezira_StrokeCache_t *cache,
+                           const float *path, int n, float w, float l, float c,
+                           float M_a, float M_b, float M_c, float M_d, float M_e, float M_f)
+{
+    gezira_StrokeCacheEntry_t *e, *victim = NULL;
+    float s = gezira_similarity_scale (M_a, M_b, M_c, M_d);
+    unsigned int now = cache->frame + 1;
+    int i;
+
+    if (s == 0)
+        return nile_Process_pipe (
+            gezira_TransformBeziers (p, M_a, M_b, M_c, M_d, M_e, M_f),
+            gezira_StrokeBezierPath_SinglePass (p, w, l, c), NILE_NULL);
+
+    w /= s;
+    for (i = 0; i < GEZIRA_STROKE_CACHE_ENTRIES; i++) {
+        e = &cache->entries[i];
+        if (e->state == GEZIRA_STROKE_CACHE_FREE) {
+            if (!victim || victim->state != GEZIRA_STROKE_CACHE_FREE)
+                victim = e;
+            continue;
+        }
+        if (e->path == path && e->path_n == n && e->l == l && e->c == c &&
+            fabsf (e->w - w) <= 1e-4f * e->w) {
+            if (e->state == GEZIRA_STROKE_CACHE_READY) {
+                e->last_used = now;
+                return nile_Process_pipe (
+                    gezira_StrokeCache_process (p, e, 1),
+                    gezira_TransformBeziers (p, M_a, M_b, M_c, M_d, M_e, M_f), NILE_NULL);
+            }
+            victim = NULL;
+            break;
+        }
+        if (e->last_used != now && e->state == GEZIRA_STROKE_CACHE_READY &&
+            (!victim || (victim->state != GEZIRA_STROKE_CACHE_FREE &&
+                         e->last_used < victim->last_used)))
+            victim = e;
+    }
+
+    if (!victim)
+        return nile_Process_pipe (
+            gezira_StrokeBezierPath_SinglePass (p, w, l, c),
+            gezira_TransformBeziers (p, M_a, M_b, M_c, M_d, M_e, M_f), NILE_NULL);
+
+    e = victim;
+    free (e->beziers);
+    e->path = path;
+    e->path_n = n;
+    e->w = w;
+    e->l = l;
+    e->c = c;
+    e->beziers = NULL;
+    e->n = e->capacity = 0;
+    e->state = GEZIRA_STROKE_CACHE_RECORDING;
+    e->recorded = 0;
+    e->last_used = now;
+    return nile_Process_pipe (
+        gezira_StrokeBezierPath_SinglePass (p, w, l, c),
+        gezira_StrokeCache_process (p, e, 0),
+        gezira_TransformBeziers (p, M_a, M_b, M_c, M_d, M_e, M_f), NILE_NULL);
+}
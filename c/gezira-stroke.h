@@ -0,0 +1,114 @@
+#ifndef GEZIRA_STROKE_H
+#define GEZIRA_STROKE_H
+
+#include "nile.h"
+
+/* StrokeOneSide and StrokeBezierPath from stroke.nl, with the offset,
+   join and cap recursion done on explicit stacks inside one process.
+   Subpaths start as in StrokeBezierPath_SinglePass below; StrokeBezierPath
+   itself runs StrokeBezierPath_Iterative. */
+
+nile_Process_t *
+gezira_StrokeOneSide_Iterative (nile_Process_t *p, float w, float l, float c);
+
+nile_Process_t *
+gezira_StrokeBezierPath_Iterative (nile_Process_t *p, float w, float l, float c);
+
+/* StrokeBezierPath emitting both sides as the path streams in, holding
+   only the first and previous beziers. The outline's beziers come out in
+   path order rather than as one closed contour, which the nonzero fill
+   accepts.
+
+   The input may hold any number of subpaths, each closed or capped on its
+   own. A subpath starts at any bezier that does not begin where the
+   previous one ended, and after a move record (P, P, P), which separates
+   subpaths that touch. Move records have no extent, so the same stream
+   can be filled as is. */
+nile_Process_t *
+gezira_StrokeBezierPath_SinglePass (nile_Process_t *p, float w, float l, float c);
+
+#define GEZIRA_DASH_MAX     32
+#define GEZIRA_DASH_SAMPLES 8
+#define GEZIRA_DASH_DOT     0.001f
+
+/* Splits a path into open subpaths for StrokeBezierPath_SinglePass,
+   alternating n dash and gap lengths (repeated once if n is odd) starting
+   phase into the pattern. The pattern restarts with each input subpath,
+   and move records are passed on. Arc length is measured on a polyline of
+   GEZIRA_DASH_SAMPLES chords per bezier. Zero-length dashes become
+   GEZIRA_DASH_DOT long subpaths along the path, which round and square
+   caps draw as dots. */
+nile_Process_t *
+gezira_DashBezierPath (nile_Process_t *p, int n, const float *dashes, float phase);
+
+#define GEZIRA_HAIRLINE_TOLERANCE    0.1f
+#define GEZIRA_HAIRLINE_MAX_SEGMENTS 256
+
+/* Strokes device-space beziers of width w ≤ 1 straight to CoverageSpans,
+   in place of StrokeBezierPath → ClipBeziers → Rasterize. Beziers are
+   flattened to within GEZIRA_HAIRLINE_TOLERANCE and each segment is drawn
+   as a box-filtered line, skipping pixels outside the clip bounds rounded
+   out to whole pixels. Spans are one pixel long and unsorted. A pixel
+   where consecutive segments meet comes once, with their coverages
+   summed. */
+nile_Process_t *
+gezira_RasterizeHairline (nile_Process_t *p, float w,
+                          float min_x, float min_y, float max_x, float max_y);
+
+/* CalculateBounds for the outline StrokeBezierPath (w, l, c) would make,
+   without making it: the path's control point bounds grown by the farthest
+   any offset curve, join or cap can reach. Conservative. */
+nile_Process_t *
+gezira_CalculateStrokeBounds (nile_Process_t *p, float w, float l, float c);
+
+/* The same for a path of n floats in memory, so that strokes can be culled
+   or left unclipped before any pipeline is built. Writes (min_x, min_y,
+   max_x, max_y) to bounds and returns 0 if the path is empty. */
+int
+gezira_StrokeBounds (const float *path, int n, float w, float l, float c, float *bounds);
+
+#define GEZIRA_STROKE_CACHE_ENTRIES 64
+
+/* Stroke outlines kept in path space, keyed on (path, width, miter limit,
+   cap). Outlines recorded during a frame become usable after recycle,
+   which must follow the nile_sync that finishes the frame. A path whose
+   contents change must be invalidated. */
+typedef struct {
+    const float *path;
+    int          path_n;
+    float        w, l, c;
+    float       *beziers;
+    int          n, capacity;
+    int          state;
+    int          recorded;
+    unsigned int last_used;
+} gezira_StrokeCacheEntry_t;
+
+typedef struct {
+    gezira_StrokeCacheEntry_t entries[GEZIRA_STROKE_CACHE_ENTRIES];
+    unsigned int              frame;
+} gezira_StrokeCache_t;
+
+void
+gezira_StrokeCache_init (gezira_StrokeCache_t *cache);
+
+void
+gezira_StrokeCache_done (gezira_StrokeCache_t *cache);
+
+void
+gezira_StrokeCache_recycle (gezira_StrokeCache_t *cache);
+
+void
+gezira_StrokeCache_invalidate (gezira_StrokeCache_t *cache, const float *path);
+
+/* StrokeBezierPath (w, l, c) → TransformBeziers (M), with w in device
+   space. When M is a similarity the path is stroked at w divided by its
+   scale and the outline is cached; a later call for the same path, miter
+   limit, cap and effective width replays it through TransformBeziers. Feed
+   the result the path's n floats; on a hit the input is ignored. */
+nile_Process_t *
+gezira_StrokeCache_stroke (nile_Process_t *p, gezira_StrokeCache_t *cache,
+                           const float *path, int n, float w, float l, float c,
+                           float M_a, float M_b, float M_c, float M_d, float M_e, float M_f);
+
+#endif
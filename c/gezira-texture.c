@@ -0,0 +1,508 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#define NILE_INCLUDE_PROCESS_API
+#include "nile.h"
+#include "gezira-cpu.h"
+#include "gezira.h"
+#include "gezira-image.h"
+#include "gezira-texture.h"
+
+#define Real nile_Real_t
+
+struct gezira_TextureBuffer_ {
+    gezira_TextureBuffer_t *next;
+};
+
+static void *
+gezira_TextureBuffer_alloc (size_t size)
+{
+    gezira_TextureBuffer_t *b = malloc (sizeof (*b) + size);
+    return b ? b + 1 : NULL;
+}
+
+static void
+gezira_TextureBuffer_free (void *data)
+{
+    free ((gezira_TextureBuffer_t *) data - 1);
+}
+
+static void
+gezira_Texture_retire (gezira_Texture_t *texture, void *data)
+{
+    gezira_TextureBuffer_t *b = (gezira_TextureBuffer_t *) data - 1;
+    b->next = texture->retired;
+    texture->retired = b;
+}
+
+void
+gezira_Texture_init (gezira_Texture_t *texture, gezira_Image_t *image)
+{
+    texture->source  = image;
+    texture->nlevels = 1;
+    texture->texels  = NULL;
+    texture->retired = NULL;
+    gezira_Texture_invalidate (texture);
+}
+
+void
+gezira_Texture_invalidate (gezira_Texture_t *texture)
+{
+    gezira_Image_t *image = texture->source;
+    while (texture->nlevels > 1)
+        gezira_Texture_retire (texture, texture->levels[--texture->nlevels].pixels);
+    if (texture->texels)
+        gezira_Texture_retire (texture, texture->texels);
+    texture->texels = NULL;
+    texture->version = image->version;
+    gezira_Image_init (&texture->levels[0], image->pixels,
+                       image->width, image->height, image->stride);
+}
+
+void
+gezira_Texture_recycle (gezira_Texture_t *texture)
+{
+    while (texture->retired) {
+        gezira_TextureBuffer_t *b = texture->retired;
+        texture->retired = b->next;
+        free (b);
+    }
+}
+
+void
+gezira_Texture_done (gezira_Texture_t *texture)
+{
+    gezira_Texture_invalidate (texture);
+    gezira_Texture_recycle (texture);
+}
+
+/* Writers bump the source image's version when they are created, so a
+   texture validated after that is rebuilt behind them. */
+static void
+gezira_Texture_validate (gezira_Texture_t *texture)
+{
+    if (texture->version != texture->source->version)
+        gezira_Texture_invalidate (texture);
+}
+
+typedef struct {
+    gezira_Image_t src;
+    float         *texels;
+} gezira_Texture_BuildTexels_vars_t;
+
+/* The texels are the source pixels as premultiplied floats, with the edge
+   replicated one texel out on every side so filter taps need no clamping. */
+static nile_Buffer_t *
+gezira_Texture_BuildTexels_prologue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_Texture_BuildTexels_vars_t *v = nile_Process_vars (p);
+    const gezira_Image_t *image = &v->src;
+    const uint32_t *pixels = image->pixels;
+    int    stride = image->width + 2;
+    float  lut[256];
+    int    x, y, i;
+
+    for (i = 0; i < 256; i++)
+        lut[i] = i / 255.0f;
+    for (y = -1; y <= image->height; y++) {
+        int sy = y < 0 ? 0 : y < image->height ? y : image->height - 1;
+        const uint32_t *row = pixels + sy * image->stride;
+        float *t = v->texels + (y + 1) * stride * 4;
+        for (x = -1; x <= image->width; x++) {
+            int sx = x < 0 ? 0 : x < image->width ? x : image->width - 1;
+            uint32_t C = row[sx];
+            *t++ = lut[C >> 24];
+            *t++ = lut[(C >> 16) & 0xff];
+            *t++ = lut[(C >>  8) & 0xff];
+            *t++ = lut[(C >>  0) & 0xff];
+        }
+    }
+    return out;
+}
+
+/* Filled behind the source image's writers, like the levels */
+static int
+gezira_Texture_build_texels (nile_Process_t *parent, gezira_Texture_t *texture)
+{
+    const gezira_Image_t *image = &texture->levels[0];
+    gezira_Texture_BuildTexels_vars_t *vars;
+    nile_Process_t *p;
+    int    stride = image->width + 2;
+    float *texels;
+
+    texels = gezira_TextureBuffer_alloc ((size_t) stride * (image->height + 2) * 4 * sizeof (float));
+    if (!texels)
+        return 0;
+    p = nile_Process (parent, 1, sizeof (*vars), gezira_Texture_BuildTexels_prologue, NULL, NULL);
+    if (!p) {
+        gezira_TextureBuffer_free (texels);
+        return 0;
+    }
+    vars = nile_Process_vars (p);
+    vars->src    = *image;
+    vars->texels = texels;
+    p = gezira_Image_sequence (parent, p, texture->source, 0);
+    nile_Process_feed (p, NULL, 0);
+    texture->texels = texels;
+    texture->texels_stride = stride;
+    return 1;
+}
+
+typedef struct {
+    gezira_Image_t src;
+    gezira_Image_t dst;
+} gezira_Texture_BuildLevel_vars_t;
+
+/* Each level is a 2x2 box filter of the one above it, clamping at odd edges.
+   The pixels are premultiplied, so averaging channels independently is exact. */
+static nile_Buffer_t *
+gezira_Texture_BuildLevel_prologue (nile_Process_t *p, nile_Buffer_t *out)
+{
+    gezira_Texture_BuildLevel_vars_t *v = nile_Process_vars (p);
+    const gezira_Image_t *src = &v->src;
+    const uint32_t *spixels = src->pixels;
+    uint32_t *dpixels = v->dst.pixels;
+    int width  = v->dst.width;
+    int height = v->dst.height;
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        const uint32_t *row0 = spixels + (2 * y) * src->stride;
+        const uint32_t *row1 = 2 * y + 1 < src->height ? row0 + src->stride : row0;
+        for (x = 0; x < width; x++) {
+            int x0 = 2 * x;
+            int x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+            uint32_t p00 = row0[x0], p01 = row0[x1];
+            uint32_t p10 = row1[x0], p11 = row1[x1];
+            uint32_t ag = ((p00 >> 8) & 0x00ff00ff) + ((p01 >> 8) & 0x00ff00ff) +
+                          ((p10 >> 8) & 0x00ff00ff) + ((p11 >> 8) & 0x00ff00ff);
+            uint32_t rb = (p00 & 0x00ff00ff) + (p01 & 0x00ff00ff) +
+                          (p10 & 0x00ff00ff) + (p11 & 0x00ff00ff);
+            ag += 0x00020002;
+            rb += 0x00020002;
+            dpixels[x + y * width] = ((ag << 6) & 0xff00ff00) | ((rb >> 2) & 0x00ff00ff);
+        }
+    }
+    return out;
+}
+
+/* The levels are allocated now but filled by processes sequenced on the
+   source image, so they see its pending writers' output. */
+static void
+gezira_Texture_build_levels (nile_Process_t *parent, gezira_Texture_t *texture)
+{
+    while (texture->nlevels < GEZIRA_TEXTURE_MAX_LEVELS) {
+        gezira_Image_t *src = &texture->levels[texture->nlevels - 1];
+        gezira_Image_t *dst = &texture->levels[texture->nlevels];
+        gezira_Texture_BuildLevel_vars_t *vars;
+        nile_Process_t *p;
+        uint32_t *dpixels;
+        int width  = src->width  > 1 ? src->width  / 2 : 1;
+        int height = src->height > 1 ? src->height / 2 : 1;
+
+        if (src->width == 1 && src->height == 1)
+            break;
+        dpixels = gezira_TextureBuffer_alloc (width * height * sizeof (uint32_t));
+        if (!dpixels)
+            break;
+        p = nile_Process (parent, 1, sizeof (*vars), gezira_Texture_BuildLevel_prologue, NULL, NULL);
+        if (!p) {
+            gezira_TextureBuffer_free (dpixels);
+            break;
+        }
+        gezira_Image_init (dst, dpixels, width, height, width);
+        vars = nile_Process_vars (p);
+        vars->src = *src;
+        vars->dst = *dst;
+        p = gezira_Image_sequence (parent, p, texture->source, 0);
+        nile_Process_feed (p, NULL, 0);
+        texture->nlevels++;
+    }
+}
+
+typedef struct {
+    gezira_Image_t fine;
+    gezira_Image_t coarse;
+    float          fine_sx,   fine_sy;
+    float          coarse_sx, coarse_sy;
+    float          t;
+    float          width, height;
+} gezira_ReadFromTexture_Trilinear_ARGB32_vars_t;
+
+static inline void
+gezira_Texture_bilinear (const gezira_Image_t *level, float x, float y, float w, float *C)
+{
+    const uint32_t *pixels = level->pixels;
+    int   stride = level->stride;
+    float fx = x - 0.5f;
+    float fy = y - 0.5f;
+    float flx = floorf (fx);
+    float fly = floorf (fy);
+    float u = fx - flx;
+    float v = fy - fly;
+    int   x0 = flx;
+    int   y0 = fly;
+    int   x1 = x0 + 1;
+    int   y1 = y0 + 1;
+    x0 = x0 < 0 ? 0 : x0 >= level->width  ? level->width  - 1 : x0;
+    x1 = x1 < 0 ? 0 : x1 >= level->width  ? level->width  - 1 : x1;
+    y0 = y0 < 0 ? 0 : y0 >= level->height ? level->height - 1 : y0;
+    y1 = y1 < 0 ? 0 : y1 >= level->height ? level->height - 1 : y1;
+
+    uint32_t p00 = pixels[x0 + y0 * stride], p01 = pixels[x1 + y0 * stride];
+    uint32_t p10 = pixels[x0 + y1 * stride], p11 = pixels[x1 + y1 * stride];
+    float w00 = w * (1 - u) * (1 - v), w01 = w * u * (1 - v);
+    float w10 = w * (1 - u) * v,       w11 = w * u * v;
+    int i;
+    for (i = 0; i < 4; i++) {
+        int shift = 24 - 8 * i;
+        C[i] += w00 * ((p00 >> shift) & 0xff) + w01 * ((p01 >> shift) & 0xff) +
+                w10 * ((p10 >> shift) & 0xff) + w11 * ((p11 >> shift) & 0xff);
+    }
+}
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ReadFromTexture_Trilinear_ARGB32_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_ReadFromTexture_Trilinear_ARGB32_vars_t v =
+        *(gezira_ReadFromTexture_Trilinear_ARGB32_vars_t *) nile_Process_vars (p);
+    float s = (1 / 255.0f);
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in));
+            float y = nile_Real_tof (nile_Buffer_pop_head (in));
+            float C[4] = {0, 0, 0, 0};
+            if (x >= 0 && y >= 0 && x <= v.width && y <= v.height) {
+                if (v.t < 1)
+                    gezira_Texture_bilinear (&v.fine, x * v.fine_sx, y * v.fine_sy, 1 - v.t, C);
+                if (v.t > 0)
+                    gezira_Texture_bilinear (&v.coarse, x * v.coarse_sx, y * v.coarse_sy, v.t, C);
+            }
+            nile_Buffer_push_tail (out, nile_Real (C[0] * s));
+            nile_Buffer_push_tail (out, nile_Real (C[1] * s));
+            nile_Buffer_push_tail (out, nile_Real (C[2] * s));
+            nile_Buffer_push_tail (out, nile_Real (C[3] * s));
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ReadFromTexture_Trilinear_ARGB32_body)
+
+/* (M_a, M_b, M_c, M_d) is the linear part of the matrix taking device points
+   to texture points (the one given to TransformPoints). Its larger column
+   length is the texel footprint of a device pixel, which picks the levels. */
+nile_Process_t *
+gezira_ReadFromTexture_Trilinear_ARGB32 (nile_Process_t *p, gezira_Texture_t *texture,
+                                         float M_a, float M_b, float M_c, float M_d)
+{
+    gezira_ReadFromTexture_Trilinear_ARGB32_vars_t *vars;
+    nile_Process_t *parent = p;
+    float sx = sqrtf (M_a * M_a + M_b * M_b);
+    float sy = sqrtf (M_c * M_c + M_d * M_d);
+    float lod = log2f (sx > sy ? sx : sy);
+    int   level;
+
+    gezira_Texture_validate (texture);
+    if (lod > 0 && texture->nlevels == 1)
+        gezira_Texture_build_levels (parent, texture);
+    lod = !(lod > 0) ? 0 : lod > texture->nlevels - 1 ? texture->nlevels - 1 : lod;
+    level = lod;
+    level = level < texture->nlevels - 1 ? level : texture->nlevels - 1;
+
+    p = nile_Process (p, 2, sizeof (*vars), NULL,
+                      GEZIRA_KERNEL_FOR_CPU (gezira_ReadFromTexture_Trilinear_ARGB32_body), NULL);
+    if (p) {
+        gezira_Image_t *base   = &texture->levels[0];
+        gezira_Image_t *fine   = &texture->levels[level];
+        gezira_Image_t *coarse = &texture->levels[level + 1 < texture->nlevels ? level + 1 : level];
+        vars = nile_Process_vars (p);
+        vars->fine      = *fine;
+        vars->coarse    = *coarse;
+        vars->fine_sx   = (float) fine->width    / base->width;
+        vars->fine_sy   = (float) fine->height   / base->height;
+        vars->coarse_sx = (float) coarse->width  / base->width;
+        vars->coarse_sy = (float) coarse->height / base->height;
+        vars->t         = fine == coarse ? 0 : lod - level;
+        vars->width     = base->width;
+        vars->height    = base->height;
+        p = gezira_Image_sequence (parent, p, texture->source, 0);
+    }
+    return p;
+}
+
+typedef struct {
+    const float *texels;
+    int          stride;
+    float        width, height;
+} gezira_ReadFromTexture_vars_t;
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ReadFromTexture_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_ReadFromTexture_vars_t v = *(gezira_ReadFromTexture_vars_t *) nile_Process_vars (p);
+    float xmax = v.width  - 0.5f;
+    float ymax = v.height - 0.5f;
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in));
+            float y = nile_Real_tof (nile_Buffer_pop_head (in));
+            x = x < 0 ? 0 : x > xmax ? xmax : x;
+            y = y < 0 ? 0 : y > ymax ? ymax : y;
+            const float *t = v.texels + ((int) y + 1) * v.stride + ((int) x + 1) * 4;
+            nile_Buffer_push_tail (out, nile_Real (t[0])); nile_Buffer_push_tail (out, nile_Real (t[1]));
+            nile_Buffer_push_tail (out, nile_Real (t[2])); nile_Buffer_push_tail (out, nile_Real (t[3]));
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ReadFromTexture_body)
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ReadFromTexture_Bilinear_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    gezira_ReadFromTexture_vars_t v = *(gezira_ReadFromTexture_vars_t *) nile_Process_vars (p);
+
+    while (!nile_Buffer_is_empty (in)) {
+        int m = (in->tail - in->head) / 2;
+        int o = (out->capacity - out->tail) / 4;
+        m = m < o ? m : o;
+        while (m--) {
+            float x = nile_Real_tof (nile_Buffer_pop_head (in));
+            float y = nile_Real_tof (nile_Buffer_pop_head (in));
+            x = (x < 0 ? 0 : x > v.width  ? v.width  : x) + 0.5f;
+            y = (y < 0 ? 0 : y > v.height ? v.height : y) + 0.5f;
+            int   x0 = x;
+            int   y0 = y;
+            float u  = x - x0;
+            float w  = y - y0;
+            const float *t0 = v.texels + y0 * v.stride + x0 * 4;
+            const float *t1 = t0 + v.stride;
+            float w00 = (1 - u) * (1 - w), w01 = u * (1 - w);
+            float w10 = (1 - u) * w,       w11 = u * w;
+            nile_Buffer_push_tail (out, nile_Real (w00 * t0[0] + w01 * t0[4] + w10 * t1[0] + w11 * t1[4]));
+            nile_Buffer_push_tail (out, nile_Real (w00 * t0[1] + w01 * t0[5] + w10 * t1[1] + w11 * t1[5]));
+            nile_Buffer_push_tail (out, nile_Real (w00 * t0[2] + w01 * t0[6] + w10 * t1[2] + w11 * t1[6]));
+            nile_Buffer_push_tail (out, nile_Real (w00 * t0[3] + w01 * t0[7] + w10 * t1[3] + w11 * t1[7]));
+        }
+        if (nile_Buffer_tailroom (out) < 4)
+            out = nile_Process_append_output (p, out);
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ReadFromTexture_Bilinear_body)
+
+int
+gezira_Texture_prepare (nile_Process_t *parent, gezira_Texture_t *texture)
+{
+    gezira_Texture_validate (texture);
+    return texture->texels || gezira_Texture_build_texels (parent, texture);
+}
+
+static nile_Process_t *
+gezira_ReadFromTexture_ (nile_Process_t *p, gezira_Texture_t *texture, nile_Process_body_t body)
+{
+    gezira_ReadFromTexture_vars_t *vars;
+    nile_Process_t *parent = p;
+    if (!gezira_Texture_prepare (parent, texture))
+        return NULL;
+    p = nile_Process (p, 2, sizeof (*vars), NULL, body, NULL);
+    if (p) {
+        vars = nile_Process_vars (p);
+        vars->texels = texture->texels;
+        vars->stride = texture->texels_stride * 4;
+        vars->width  = texture->levels[0].width;
+        vars->height = texture->levels[0].height;
+        p = gezira_Image_sequence (parent, p, texture->source, 0);
+    }
+    return p;
+}
+
+/* Sample points are clamped to the texture's bounds, as with PadTexture. */
+nile_Process_t *
+gezira_ReadFromTexture (nile_Process_t *p, gezira_Texture_t *texture)
+{
+    return gezira_ReadFromTexture_ (p, texture,
+                                    GEZIRA_KERNEL_FOR_CPU (gezira_ReadFromTexture_body));
+}
+
+nile_Process_t *
+gezira_ReadFromTexture_Bilinear (nile_Process_t *p, gezira_Texture_t *texture)
+{
+    return gezira_ReadFromTexture_ (p, texture,
+                                    GEZIRA_KERNEL_FOR_CPU (gezira_ReadFromTexture_Bilinear_body));
+}
+
+GEZIRA_KERNEL nile_Buffer_t *
+gezira_ExpandSpans_Loop_body (nile_Process_t *p, nile_Buffer_t *in, nile_Buffer_t *out)
+{
+    while (!nile_Buffer_is_empty (in) && !nile_Buffer_quota_hit (out)) {
+        float x = nile_Real_tof (nile_Buffer_pop_head (in));
+        Real  y = nile_Buffer_pop_head (in);
+        float c = nile_Real_tof (nile_Buffer_pop_head (in));
+        float l = nile_Real_tof (nile_Buffer_pop_head (in));
+        Real  c_, ic;
+        if (!(c > 0 && l > 0))
+            continue;
+        c_ = nile_Real (c);
+        ic = nile_Real (1 - c);
+        for (;;) {
+            int n;
+            if (nile_Buffer_tailroom (out) < 4)
+                out = nile_Process_append_output (p, out);
+            n = nile_Buffer_tailroom (out) / 4;
+            n = n < ceilf (l) ? n : (int) ceilf (l);
+            l -= n;
+            while (n--) {
+                nile_Buffer_push_tail (out, nile_Real (x++));
+                nile_Buffer_push_tail (out, y);
+                nile_Buffer_push_tail (out, c_);
+                nile_Buffer_push_tail (out, ic);
+            }
+            if (!(l > 0))
+                break;
+            if (nile_Buffer_quota_hit (out)) {
+                if (nile_Buffer_headroom (in) < 4)
+                    in = nile_Process_prefix_input (p, in);
+                nile_Buffer_push_head (in, nile_Real (l));
+                nile_Buffer_push_head (in, c_);
+                nile_Buffer_push_head (in, y);
+                nile_Buffer_push_head (in, nile_Real (x));
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+GEZIRA_KERNEL_VARIANTS (gezira_ExpandSpans_Loop_body)
+
+nile_Process_t *
+gezira_ExpandSpans_Loop (nile_Process_t *p)
+{
+    return nile_Process (p, 4, 0, NULL, GEZIRA_KERNEL_FOR_CPU (gezira_ExpandSpans_Loop_body), NULL);
+}
+
+nile_Process_t *
+gezira_ApplyTexture_Loop (nile_Process_t *p, nile_Process_t *t)
+{
+    return nile_Process_pipe (
+        gezira_ExpandSpans_Loop (p),
+        nile_DupZip (p, 4, nile_Process_pipe (gezira_ExtractSamplePoints (p), t, NILE_NULL), 4,
+                     nile_Process_pipe (NILE_NULL), 4),
+        NILE_NULL);
+}
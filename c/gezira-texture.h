@@ -0,0 +1,64 @@
+#ifndef GEZIRA_TEXTURE_H
+#define GEZIRA_TEXTURE_H
+
+#include "nile.h"
+#include "gezira-image.h"
+
+#define GEZIRA_TEXTURE_MAX_LEVELS 16
+
+typedef struct gezira_TextureBuffer_ gezira_TextureBuffer_t;
+
+/* Levels and texels made from the source image. Those superseded when the
+   source changes are kept until recycle, which must follow the nile_sync
+   that finishes the processes reading them. */
+typedef struct {
+    gezira_Image_t         *source;
+    unsigned int            version;
+    gezira_Image_t          levels[GEZIRA_TEXTURE_MAX_LEVELS];
+    int                     nlevels;
+    float                  *texels;
+    int                     texels_stride;
+    gezira_TextureBuffer_t *retired;
+} gezira_Texture_t;
+
+void
+gezira_Texture_init (gezira_Texture_t *texture, gezira_Image_t *image);
+
+void
+gezira_Texture_done (gezira_Texture_t *texture);
+
+void
+gezira_Texture_invalidate (gezira_Texture_t *texture);
+
+void
+gezira_Texture_recycle (gezira_Texture_t *texture);
+
+/* Brings texels up to date with the source image. They are filled by a
+   process sequenced on it, so readers must be sequenced on it too. Returns
+   0 if they could not be allocated. */
+int
+gezira_Texture_prepare (nile_Process_t *parent, gezira_Texture_t *texture);
+
+nile_Process_t *
+gezira_ReadFromTexture (nile_Process_t *p, gezira_Texture_t *texture);
+
+nile_Process_t *
+gezira_ReadFromTexture_Bilinear (nile_Process_t *p, gezira_Texture_t *texture);
+
+nile_Process_t *
+gezira_ReadFromTexture_Trilinear_ARGB32 (nile_Process_t *p, gezira_Texture_t *texture,
+                                         float M_a, float M_b, float M_c, float M_d);
+
+/* ExpandSpans from texture.nl, writing each span's CoveragePoints in one
+   loop instead of pushing the rest of the span back onto the input per
+   pixel. The rest goes back only when the output quota is hit. Points of
+   fully covered spans have ic = 0, which WriteToImage stores without
+   blending. */
+nile_Process_t *
+gezira_ExpandSpans_Loop (nile_Process_t *p);
+
+/* ApplyTexture (t) over ExpandSpans_Loop */
+nile_Process_t *
+gezira_ApplyTexture_Loop (nile_Process_t *p, nile_Process_t *t);
+
+#endif
@@ -1,6 +1,7 @@
 #define NILE_INCLUDE_PROCESS_API
 #include "nile.h"
 #include "gezira.h"
+#include "gezira-stroke.h"
 
 #define IN_QUANTUM 6
 #define OUT_QUANTUM 6
@@ -2459,61 +2460,15 @@ gezira_SanitizeBezierPath (nile_Process_t *p)
 #define IN_QUANTUM 6
 #define OUT_QUANTUM 6
 
-typedef struct {
-    nile_Real_t v_w;
-    nile_Real_t v_l;
-    nile_Real_t v_c;
-} gezira_StrokeBezierPath_vars_t;
-
-static nile_Buffer_t *
-gezira_StrokeBezierPath_prologue (nile_Process_t *p, nile_Buffer_t *out)
-{
-    gezira_StrokeBezierPath_vars_t *vars = nile_Process_vars (p);
-    gezira_StrokeBezierPath_vars_t v = *vars;
-    ; /* no-op */
-    nile_Process_t *t_1 = gezira_StrokeOneSide(p, nile_Real_tof (v.v_w), nile_Real_tof (v.v_l), nile_Real_tof (v.v_c));
-    nile_Real_t t_2 = nile_Real (6);
-    nile_Real_t t_3 = nile_Real (6);
-    nile_Process_t *t_4 = nile_Reverse(p, nile_Real_toi (t_3));
-    nile_Process_t *t_5 = gezira_StrokeOneSide(p, nile_Real_tof (v.v_w), nile_Real_tof (v.v_l), nile_Real_tof (v.v_c));
-    nile_Process_t *t_6 = nile_Process_pipe (gezira_ReverseBeziers(p), t_5, NILE_NULL);
-    nile_Process_t *t_7 = nile_Process_pipe (t_4, t_6, NILE_NULL);
-    nile_Real_t t_8 = nile_Real (6);
-    nile_Process_t *t_9 = nile_DupCat(p, 6, t_1, nile_Real_toi (t_2), t_7, nile_Real_toi (t_8));
-    nile_Process_t *t_10 = nile_Process_pipe (gezira_SanitizeBezierPath(p), t_9, NILE_NULL);
-    return nile_Process_swap (p, t_10, out);
-    *vars = v;
-    return out;
-}
-
-#define gezira_StrokeBezierPath_body 0
-
-static nile_Buffer_t *
-gezira_StrokeBezierPath_epilogue (nile_Process_t *p, nile_Buffer_t *out)
-{
-    gezira_StrokeBezierPath_vars_t *vars = nile_Process_vars (p);
-    gezira_StrokeBezierPath_vars_t v = *vars;
-    ; /* no-op */
-    return out;
-}
-
+/* stroke.nl's StrokeBezierPath, with StrokeOneSide done by the iterative
+   stroker, which also starts a new subpath at each move record */
 nile_Process_t *
 gezira_StrokeBezierPath (nile_Process_t *p, 
                          float v_w, 
                          float v_l, 
                          float v_c)
 {
-    gezira_StrokeBezierPath_vars_t *vars;
-    gezira_StrokeBezierPath_vars_t v;
-    p = nile_Process (p, IN_QUANTUM, sizeof (*vars), gezira_StrokeBezierPath_prologue, gezira_StrokeBezierPath_body, gezira_StrokeBezierPath_epilogue);
-    if (p) {
-        vars = nile_Process_vars (p);
-        v.v_w = nile_Real (v_w);
-        v.v_l = nile_Real (v_l);
-        v.v_c = nile_Real (v_c);
-        *vars = v;
-    }
-    return p;
+    return gezira_StrokeBezierPath_Iterative (p, v_w, v_l, v_c);
 }
 
 #undef IN_QUANTUM